@@ -10,4 +10,6 @@ lib = require("lib")
 ---------------------------------
 -- Actual code
 ---------------------------------
-upspring.make_archive_atlas(arg[1], arg[2], true);
\ No newline at end of file
+-- Usage: archive_to_atlas.lua <archive> <atlas.yaml> [--quality=fast|normal|high]
+local options = lib.atlas.options(arg)
+upspring.make_archive_atlas(arg[1], arg[2], true, lib.atlas.quality(options.quality));
\ No newline at end of file
@@ -10,60 +10,60 @@ lib = require("lib")
 ---------------------------------
 -- Actual code
 ---------------------------------
+-- Usage: convert_many_to_atlas.lua <archive> <atlas.yaml> [--quality=fast|normal|high] <3do>...
+local options, models = lib.atlas.options(arg)
+local quality = lib.atlas.quality(options.quality)
+
 upspring.load_archive(arg[1])
 
 local atlas = upspring.atlas();
 
-for i, v in ipairs(arg) do
-    if i > 2 then
-        print("-- Loading the 3do", v)
-        local model = upspring.Model()
-        local ok = model:Load3DO(v)
-        
-        if ok then
-        else
-            error("-- Load failed", v)
-            return;
-        end
-
-        model:load_3do_textures(upspring.get_texture_handler())
-        model:add_textures_to_atlas(atlas)
+for _, v in ipairs(models) do
+    print("-- Loading the 3do", v)
+    local model = upspring.Model()
+    local ok = model:Load3DO(v)
+
+    if ok then
+    else
+        error("-- Load failed", v)
+        return;
     end
+
+    model:load_3do_textures(upspring.get_texture_handler())
+    model:add_textures_to_atlas(atlas)
 end
 
 print("-- Packing atlas")
 atlas:pack();
 
 print("-- Saving atlas to", arg[2])
-atlas:save(arg[2])
+atlas:save(arg[2], quality)
 print("-- Saved atlas")
 
 
-for i, v in ipairs(arg) do
-    if i > 2 then
-        print("-- Converting the 3do", v)
-        local model = upspring.Model()
-        local ok = model:Load3DO(v)
+for _, v in ipairs(models) do
+    print("-- Converting the 3do", v)
+    local model = upspring.Model()
+    local ok = model:Load3DO(v)
 
-        -- model:Remove3DOBase();       
-        model.root:Rotate180();
-        model:Remove3DOBase()
+    -- model:Remove3DOBase();       
+    model.root:Rotate180();
+    model:Remove3DOBase()
 
-        model:convert_to_atlas_s3o(atlas)
+    model:convert_to_atlas_s3o(atlas)
 
-        model.root:NormalizeNormals();
+    model.root:NormalizeNormals();
 
-        -- model:Triangleize()
+    -- model:Triangleize()
 
-        local _dirname = lib.utils.dirname(v)
-        local _fileName = lib.utils.basename(v, lib.utils.get_suffix(v))
+    local _dirname = lib.utils.dirname(v)
+    local _fileName = lib.utils.basename(v, lib.utils.get_suffix(v))
 
-        local _s3oOut = lib.utils.join_paths(_dirname, _fileName .. ".s3o")
-        local ok = model:SaveS3O(_s3oOut)
-        if ok then
-            print("-- Stored S3O to: '" .. _s3oOut .. "'")
-        else
-            print("-- Store failed")
-        end
+    local _s3oOut = lib.utils.join_paths(_dirname, _fileName .. ".s3o")
+    local ok = model:SaveS3O(_s3oOut)
+    if ok then
+        print("-- Stored S3O to: '" .. _s3oOut .. "'")
+    else
+        print("-- Store failed")
     end
 end
\ No newline at end of file
@@ -0,0 +1,37 @@
+--- Helpers shared by the atlas scripts.
+local atlas = {}
+
+--- Splits the script arguments after the archive and the atlas into --name=value options and
+-- the remaining ones (the models).
+function atlas.options(args)
+    local options = {}
+    local rest = {}
+    for i, v in ipairs(args) do
+        if i > 2 then
+            local name, value = v:match("^%-%-([%w_]+)=(.*)$")
+            if name then
+                options[name] = value
+            else
+                table.insert(rest, v)
+            end
+        end
+    end
+    return options, rest
+end
+
+--- The compression preset for a --quality=fast|normal|high option, normal if it's nil.
+function atlas.quality(name)
+    local qualities = {
+        fast = upspring.Quality_Fast,
+        normal = upspring.Quality_Normal,
+        high = upspring.Quality_High,
+    }
+
+    local quality = qualities[string.lower(name or "normal")]
+    if quality == nil then
+        error("-- Unknown quality: " .. name .. ", use fast, normal or high")
+    end
+    return quality
+end
+
+return atlas
@@ -1,3 +1,4 @@
 return {
     utils = require('lib.utils');
+    atlas = require('lib.atlas');
 }
\ No newline at end of file
@@ -10,30 +10,45 @@ lib = require("lib")
 ---------------------------------
 -- Actual code
 ---------------------------------
+-- Usage: many_to_atlas.lua <archive> <atlas.yaml> [--update=<existing.yaml>]
+--                          [--quality=fast|normal|high] [--lossless=yes] <3do>...
+-- With --update the textures of the existing atlas keep their place, only new ones get packed.
+-- --quality selects the DDS compression preset, normal by default.
+-- --lossless=yes also writes an uncompressed TGA of every page that later updates start from,
+-- updated atlases keep writing it when they have one.
+local options, models = lib.atlas.options(arg)
+local quality = lib.atlas.quality(options.quality)
+
 upspring.load_archive(arg[1])
 
 local atlas = upspring.atlas();
 
-for i, v in ipairs(arg) do
-    if i > 2 then
-        print("-- Loading the 3do", v)
-        local model = upspring.Model()
-        local ok = model:Load3DO(v)
-        
-        if ok then
-        else
-            error("-- Load failed: " .. v)
-            return;
-        end
-
-        model:load_3do_textures(upspring.get_texture_handler())
-        model:add_textures_to_atlas(atlas)
+if options.update and not atlas:load_yaml(options.update) then
+    error("-- Failed to load the atlas: " .. options.update)
+    return;
+end
+if options.lossless == "yes" then
+    atlas:lossless(true)
+end
+
+for _, v in ipairs(models) do
+    print("-- Loading the 3do", v)
+    local model = upspring.Model()
+    local ok = model:Load3DO(v)
+
+    if ok then
+    else
+        error("-- Load failed: " .. v)
+        return;
     end
+
+    model:load_3do_textures(upspring.get_texture_handler())
+    model:add_textures_to_atlas(atlas)
 end
 
 print("-- Packing atlas")
 atlas:pack();
 
 print("-- Saving atlas to", arg[2])
-atlas:save(arg[2])
+atlas:save(arg[2], quality)
 print("-- Saved atlas")
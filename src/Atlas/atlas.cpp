@@ -2,9 +2,12 @@
 
 #include <iostream>
 #include <fstream>
+#include <cstring>
+#include <string_view>
 
 #include "../Texture.h"
 #include "../string_util.h"
+#include "../math/hash.h"
 
 #include "yaml-cpp/yaml.h"
 #include "spdlog/spdlog.h"
@@ -13,18 +16,60 @@
 #include "TXPK/Core/Rectangle.hpp"
 #include "TXPK/Packers/BlackspawnPacker.hpp"
 
-atlas::atlas() : packer_(std::make_shared<txpk::BlackspawnPacker>()) {}
+#include "maxrects_packer.hpp"
+
+atlas::atlas()
+    : packer_(std::make_shared<maxrects_packer>()),
+      max_page_size_(0),
+      allow_rotation_(false),
+      lossless_(false),
+      packed_(false) {}
+
+bool atlas::packer(const std::string& par_name) {
+  if (par_name == "maxrects") {
+    packer_ = std::make_shared<maxrects_packer>();
+  } else if (par_name == "maxrects_pow2") {
+    packer_ = std::make_shared<maxrects_packer>(true);
+  } else if (par_name == "blackspawn") {
+    packer_ = std::make_shared<txpk::BlackspawnPacker>();
+  } else {
+    spdlog::error("Unknown atlas packer '{}'", par_name);
+    return false;
+  }
+
+  packed_ = false;
+  return true;
+}
 
 bool atlas::load_yaml(const std::string& par_path) {
   auto path = std::filesystem::path(par_path).replace_extension(".yaml").string();
+  auto index_path = std::filesystem::path(par_path).replace_extension(".atlasidx").string();
 
-  auto ainfoOpt = atlas_info::load(path);
+  // Prefer the binary index unless the YAML got edited after it was written.
+  std::optional<atlas_info> ainfoOpt;
+  std::error_code err;
+  const auto index_time = std::filesystem::last_write_time(index_path, err);
+  if (!err && index_time >= std::filesystem::last_write_time(path, err) && !err) {
+    ainfoOpt = atlas_info::load_index(index_path);
+  }
+
+  if (!ainfoOpt) {
+    ainfoOpt = atlas_info::load(path);
+  }
   if (!ainfoOpt) {
     return false;
   }
 
   info(ainfoOpt.value());
 
+  fixed_ = info_.textures;
+  fixed_images_.clear();
+  for (std::uint32_t page = 0; page < info_.page_count(); page++) {
+    fixed_images_.push_back(info_.page(page).color_image);
+  }
+  lossless_ = std::filesystem::exists(lossless_path(fixed_images_.front()), err);
+  packed_ = false;
+
   return true;
 }
 
@@ -32,18 +77,21 @@ atlas atlas::make_from_archive(const std::string& par_archive, const std::string
                                bool par_power_of_two) {
   TextureHandler texture_handler = TextureHandler();
 
-  if (!texture_handler.LoadFiltered(par_archive, [](const std::string& par_path) -> std::string {
-        if (par_path.rfind("unittextures/tatex/", 0) == 0) {
-          return std::filesystem::path(par_path).replace_extension("").string().substr(
-              std::string("unittextures/tatex/").length());
-        }
-        return "";
-      })) {
+  if (!texture_handler.LoadFiltered(
+          par_archive,
+          [](const std::string& par_path) -> std::string {
+            if (par_path.rfind("unittextures/tatex/", 0) == 0) {
+              return std::filesystem::path(par_path).replace_extension("").string().substr(
+                  std::string("unittextures/tatex/").length());
+            }
+            return "";
+          },
+          {"unittextures/tatex/"})) {
     spdlog::error("Failed to load archive {}", par_archive);
     return atlas();
   }
 
-  std::vector<ImagePtr> images;
+  std::vector<std::shared_ptr<Texture>> textures;
   for (const auto& mapE : texture_handler.textures()) {
     if (mapE.second->image->channels() < 3) {
       spdlog::warn("Skippping: '{}'", mapE.first);
@@ -52,115 +100,586 @@ atlas atlas::make_from_archive(const std::string& par_archive, const std::string
 
     spdlog::debug("Loading texture: {}", mapE.first);
 
-    images.push_back(mapE.second->image);
+    textures.push_back(mapE.second);
   }
 
   auto atl = atlas();
-  atl.add_3do_textures(images, par_power_of_two);
+  atl.add_3do_textures(textures, par_power_of_two);
 
   return atl;
 }
 
-bool atlas::add_3do_textures(std::vector<ImagePtr> par_images, bool par_power_of_two) {
+bool atlas::margin(std::uint32_t par_margin) {
+  if (!fixed_.empty() && par_margin != info_.margin) {
+    spdlog::error("The margin of a loaded atlas can't be changed");
+    return false;
+  }
+
+  info_.margin = par_margin;
+  return true;
+}
+
+void atlas::max_page_size(std::uint32_t par_size) {
+  max_page_size_ = par_size;
+  packed_ = false;
+}
+
+void atlas::allow_rotation(bool par_allow) {
+  allow_rotation_ = par_allow;
+  packed_ = false;
+}
+
+bool atlas::is_loaded_(const std::string& par_name) const {
+  return info_.index.find(to_lower(par_name)) != info_.index.end();
+}
+
+bool atlas::add_3do_textures(const std::vector<std::shared_ptr<Texture>>& par_textures,
+                             bool par_power_of_two) {
+  // A model using only textures of the loaded atlas stays where it is.
+  const bool has_new =
+      std::any_of(par_textures.begin(), par_textures.end(), [this](const auto& par_texture) {
+        return par_texture != nullptr && !par_texture->HasError() &&
+               !is_loaded_(par_texture->image->name());
+      });
+  if (!has_new) {
+    return true;
+  }
+
   std::vector<ImagePtr> add;
-  for (const auto& img : par_images) {
-    if (auto it_textures =
-            std::find_if(textures_.begin(), textures_.end(),
-                         [img](txpk::TexturePtr par_tex) { return par_tex->name == img->name(); });
-        it_textures != std::end(textures_)) {
+  std::vector<ImagePtr> copies;
+  std::vector<std::string> group;
+  for (const auto& tex : par_textures) {
+    if (tex == nullptr or tex->HasError()) {
       continue;
     }
 
-    if (par_power_of_two) {
-      if (!img->to_power_of_two()) {
-        spdlog::error("Power of two failed");
-        continue;
-      }
-    }
+    group.push_back(tex->image->name());
 
-    // On teamcolor we copy the red channel to green, on normal textures we add a opaque alpha.
-    if (img->is_team_color()) {
-      if (!img->threedo_to_s3o()) {
-        spdlog::error("image->threedo_to_s3o failed, error was: {}", img->error());
-        continue;
-      }
-    } else if (!img->add_opaque_alpha()) {
-      spdlog::error("image->add_opaque_alpha failed, error was: {}", img->error());
+    if (names_.find(to_lower(tex->image->name())) != names_.end()) {
       continue;
     }
 
-    auto marginImage = std::make_shared<Image>();
-
-    // Copy attributes.
-    marginImage->name(img->name());
-    marginImage->owidth(img->width());
-    marginImage->oheight(img->height());
+    // On teamcolor we copy the red channel to green, on normal textures we add a opaque alpha.
+    std::uint32_t variant = tex->image->is_team_color() ? TEXVAR_TEAMCOLOR : TEXVAR_OPAQUE;
+    if (par_power_of_two) {
+      variant |= TEXVAR_POW2;
+    }
 
-    marginImage->create(img->width() + (ATLAS_MARGIN * 2), img->height() + (ATLAS_MARGIN * 2), 4);
-    marginImage->clear_color(0.0f, 0.0f, 0.0f, 0.0f);
+    auto img = tex->GetVariant(variant);
+    if (img->has_error()) {
+      continue;
+    }
 
-    if (!marginImage->blit(img, ATLAS_MARGIN, ATLAS_MARGIN, 0, 0, 0, 0, img->width(), img->height(),
-                           1)) {
-      spdlog::error("image->blit failed, error was: {}", img->error());
+    auto marginImage = add_margin_(img, img->width(), img->height());
+    if (marginImage == nullptr) {
       continue;
     }
 
-    add.push_back(marginImage);
+    (is_loaded_(tex->image->name()) ? copies : add).push_back(marginImage);
   }
 
-  add_textures(add);
+  add_textures_(add, group, copies);
 
   return true;
 }
 
 bool atlas::add_textures(std::vector<ImagePtr> par_images) {
+  // A model using only textures of the loaded atlas stays where it is.
+  const bool has_new =
+      std::any_of(par_images.begin(), par_images.end(),
+                  [this](const ImagePtr& par_image) { return !is_loaded_(par_image->name()); });
+  if (!has_new) {
+    return true;
+  }
+
+  std::vector<ImagePtr> add;
+  std::vector<ImagePtr> copies;
+  std::vector<std::string> group;
+  add.reserve(par_images.size());
+  group.reserve(par_images.size());
   for (const auto& img : par_images) {
+    group.push_back(img->name());
+
+    if (names_.find(to_lower(img->name())) != names_.end()) {
+      continue;
+    }
+
+    // U/V add the margin to every texture, these need it as well.
+    const int orig_width = img->owidth() > 0 ? img->owidth() : img->width();
+    const int orig_height = img->oheight() > 0 ? img->oheight() : img->height();
+    auto marginImage = add_margin_(img, orig_width, orig_height);
+    if (marginImage == nullptr) {
+      continue;
+    }
+
+    (is_loaded_(img->name()) ? copies : add).push_back(marginImage);
+  }
+
+  return add_textures_(add, group, copies);
+}
+
+ImagePtr atlas::add_margin_(const ImagePtr& par_image, int par_orig_width,
+                            int par_orig_height) const {
+  auto marginImage = std::make_shared<Image>();
+  const int margin = static_cast<int>(info_.margin);
+  const int width = par_image->width();
+  const int height = par_image->height();
+
+  // Copy attributes.
+  marginImage->name(par_image->name());
+  marginImage->owidth(par_orig_width);
+  marginImage->oheight(par_orig_height);
+
+  marginImage->create(width + (margin * 2), height + (margin * 2), 4);
+  marginImage->clear_color(0.0f, 0.0f, 0.0f, 0.0f);
+
+  if (!marginImage->blit(par_image, margin, margin, 0, 0, 0, 0, width, height, 1)) {
+    spdlog::error("image->blit failed, error was: {}", par_image->error());
+    return nullptr;
+  }
+
+  if (margin > 0 && !marginImage->extend_edges(margin, margin, width, height, EdgeMode::Clamp)) {
+    spdlog::error("image->extend_edges failed, error was: {}", marginImage->error());
+    return nullptr;
+  }
+
+  return marginImage;
+}
+
+bool atlas::add_textures_(const std::vector<ImagePtr>& par_images,
+                          const std::vector<std::string>& par_group,
+                          const std::vector<ImagePtr>& par_copies) {
+  const auto make_texture = [](const ImagePtr& par_image) -> std::shared_ptr<txpk::Texture> {
     auto txTexture = std::make_shared<txpk::Texture>();
+    if (!txTexture->loadFromIL(par_image->id())) {
+      return nullptr;
+    }
+
+    txTexture->name = par_image->name();
+    txTexture->orig_width = par_image->owidth();
+    txTexture->orig_height = par_image->oheight();
+    return txTexture;
+  };
+
+  for (const auto& img : par_images) {
+    auto [it_name, inserted] = names_.emplace(to_lower(img->name()), 0);
+    if (!inserted) {
+      continue;
+    }
+
+    auto txTexture = make_texture(img);
+    if (txTexture == nullptr) {
+      names_.erase(it_name);
+      continue;
+    }
+
+    // Byte identical textures share one rect, they only get an own entry in the atlas info.
+    const auto pixels = txTexture->getRawPixelData();
+    std::size_t hash = HASH_SEED;
+    hash_combine(hash, txTexture->orig_width, txTexture->orig_height,
+                 std::string_view(reinterpret_cast<const char*>(pixels.data()),
+                                  pixels.size() * sizeof(txpk::Color4)));
+
+    auto& candidates = content_hashes_[hash];
+    auto it_same = std::find_if(candidates.begin(), candidates.end(), [&](std::size_t par_index) {
+      const auto& other = textures_[par_index];
+      if (other->orig_width != txTexture->orig_width ||
+          other->orig_height != txTexture->orig_height ||
+          other->getBounds()->width != txTexture->getBounds()->width) {
+        return false;
+      }
+
+      const auto other_pixels = other->getRawPixelData();
+      return other_pixels.size() == pixels.size() &&
+             std::memcmp(other_pixels.data(), pixels.data(),
+                         pixels.size() * sizeof(txpk::Color4)) == 0;
+    });
+    if (it_same != candidates.end()) {
+      spdlog::debug("'{}' is the same as '{}'", txTexture->name, textures_[*it_same]->name);
+      aliases_.emplace_back(txTexture->name, *it_same);
+      it_name->second = *it_same;
+      continue;
+    }
+
+    it_name->second = textures_.size();
+    candidates.push_back(textures_.size());
+    textures_.push_back(txTexture);
+    copies_.push_back(false);
+  }
 
-    if (!txTexture->loadFromIL(img->id())) {
+  // Copies don't take part in the deduplication, they only get placed on new pages.
+  for (const auto& img : par_copies) {
+    auto [it_name, inserted] = names_.emplace(to_lower(img->name()), 0);
+    if (!inserted) {
       continue;
     }
 
-    txTexture->name = img->name();
-    txTexture->orig_width = img->owidth();
-    txTexture->orig_height = img->oheight();
+    auto txTexture = make_texture(img);
+    if (txTexture == nullptr) {
+      names_.erase(it_name);
+      continue;
+    }
 
+    it_name->second = textures_.size();
     textures_.push_back(txTexture);
+    copies_.push_back(true);
+  }
+
+  std::vector<std::size_t> group;
+  for (const auto& name : par_group) {
+    auto it_name = names_.find(to_lower(name));
+    if (it_name != names_.end() &&
+        std::find(group.begin(), group.end(), it_name->second) == group.end()) {
+      group.push_back(it_name->second);
+    }
+  }
+  if (!group.empty()) {
+    groups_.push_back(std::move(group));
   }
 
+  packed_ = false;
   return true;
 }
 
 bool atlas::pack() {
+  // The pages of a loaded atlas keep their size and content.
+  pages_.clear();
+  for (std::size_t i = 0; i < fixed_images_.size(); i++) {
+    const auto loaded = info_.page(static_cast<std::uint32_t>(i));
+    pages_.push_back({loaded.width, loaded.height, {}});
+  }
+
+  if (!(max_page_size_ == 0 ? pack_single_() : pack_pages_())) {
+    return false;
+  }
+
+  // Where every texture ended up, a texture can be on more than one page.
+  std::vector<std::vector<std::pair<std::uint32_t, const placement*>>> placed(textures_.size());
+  for (std::size_t page = 0; page < pages_.size(); page++) {
+    for (const auto& place : pages_[page].placements) {
+      placed[place.texture].emplace_back(static_cast<std::uint32_t>(page), &place);
+    }
+  }
+
+  std::vector<atlas_info_image> info_textures = fixed_;
+  const auto add_info = [&](std::string par_name, std::size_t par_texture) {
+    const auto& txTexture = textures_[par_texture];
+    txpk::RectanglePtr const bounds = txTexture->getBounds();
+    for (const auto& [page, place] : placed[par_texture]) {
+      info_textures.emplace_back(par_name, place->rotated ? bounds->height : bounds->width,
+                                 place->rotated ? bounds->width : bounds->height,
+                                 txTexture->orig_width, txTexture->orig_height, place->left,
+                                 place->top, page, place->rotated);
+    }
+  };
+
+  for (std::size_t i = 0; i < textures_.size(); i++) {
+    if (copies_[i] && !placed[i].empty()) {
+      spdlog::info("Copying '{}' onto a new page", textures_[i]->name);
+    } else if (!fixed_.empty() && !copies_[i]) {
+      spdlog::info("Adding '{}' to the atlas", textures_[i]->name);
+    }
+    add_info(textures_[i]->name, i);
+  }
+
+  for (auto& [name, index] : aliases_) {
+    add_info(name, index);
+  }
+
+  info_.width = pages_[0].width;
+  info_.height = pages_[0].height;
+  info_.extra_pages.resize(pages_.size() - 1);
+  for (std::size_t page = 1; page < pages_.size(); page++) {
+    info_.extra_pages[page - 1].width = pages_[page].width;
+    info_.extra_pages[page - 1].height = pages_[page].height;
+  }
+  info_.textures = info_textures;
+  info_.build_index();
+
+  packed_ = true;
+  return true;
+}
+
+bool atlas::pack_single_() {
+  // Copies of loaded textures are on the first page already.
+  std::vector<std::size_t> packed;
   txpk::RectanglePtrs rectangles;
   rectangles.reserve(textures_.size());
-  for (auto& txTexture : textures_) {
-    rectangles.push_back(txTexture->getBounds());
+  for (std::size_t i = 0; i < textures_.size(); i++) {
+    if (!copies_[i]) {
+      packed.push_back(i);
+      rectangles.push_back(textures_[i]->getBounds());
+    }
   }
 
-  if (!packer_->validate(rectangles)) {
+  if (!packer_->validate(rectangles, 0, txpk::SizeContraintType::None, allow_rotation_)) {
     spdlog::error("TXPK packer failed to validate.");
     return false;
   }
 
   spdlog::debug("found '{}' rectangles", rectangles.size());
-  bin_ = packer_->pack(rectangles, 0, txpk::SizeContraintType::None, false);
 
-  std::vector<atlas_info_image> info_textures;
+  if (pages_.empty()) {
+    txpk::Bin const bin =
+        packer_->pack(rectangles, 0, txpk::SizeContraintType::None, allow_rotation_);
+    pages_.push_back({bin.width, bin.height, {}});
+  } else {
+    // Keep everything that is already on the first page of the loaded atlas where it is.
+    txpk::RectanglePtrs fixed;
+    fixed.reserve(fixed_.size());
+    for (const auto& image : fixed_) {
+      if (image.page == 0) {
+        fixed.push_back(std::make_shared<txpk::Rectangle>(
+            image.left, image.top, image.left + image.width, image.top + image.height));
+      }
+    }
 
-  for (const auto& txTexture : textures_) {
-    txpk::RectanglePtr const bounds = txTexture->getBounds();
+    // The selected packer's power of two setting applies to the grown bin as well.
+    auto around_packer = std::dynamic_pointer_cast<maxrects_packer>(packer_);
+    if (around_packer == nullptr) {
+      around_packer = std::make_shared<maxrects_packer>();
+    }
+
+    const std::uint32_t width = pages_[0].width;
+    const std::uint32_t height = pages_[0].height;
+    if (!around_packer->pack_around(fixed, rectangles, pages_[0].width, pages_[0].height,
+                                    allow_rotation_)) {
+      return false;
+    }
 
-    info_textures.emplace_back(txTexture->name, bounds->width, bounds->height,
-                               txTexture->orig_width, txTexture->orig_height, bounds->left,
-                               bounds->top);
+    if (pages_[0].width != width || pages_[0].height != height) {
+      spdlog::warn("The atlas grew from {}x{} to {}x{}, the texture coordinates of every model "
+                   "converted to it change, reconvert all of them",
+                   width, height, pages_[0].width, pages_[0].height);
+    }
   }
 
-  info_.width = bin_.width;
-  info_.height = bin_.height;
-  info_.textures = info_textures;
+  for (const auto i : packed) {
+    txpk::RectanglePtr const bounds = textures_[i]->getBounds();
+    const bool rotated = bounds->isRotated();
+    pages_[0].placements.push_back({i, bounds->left, bounds->top, rotated});
+
+    // The texture's pixels don't get turned, save() does that, keep its bounds upright.
+    if (rotated) {
+      bounds->rotate();
+    }
+  }
 
-  packed_ = true;
+  return true;
+}
+
+bool atlas::pack_pages_() {
+  const std::uint32_t page_size = max_page_size_;
+
+  // Pages get packed by maxrects, with power of two sizes if that was asked for.
+  auto page_packer = std::dynamic_pointer_cast<maxrects_packer>(packer_);
+  if (page_packer == nullptr) {
+    page_packer = std::make_shared<maxrects_packer>();
+  }
+
+  const auto area = [this](std::size_t par_texture) {
+    const auto bounds = textures_[par_texture]->getBounds();
+    return static_cast<std::uint64_t>(bounds->width) * bounds->height;
+  };
+
+  // Packs par_members into a page, returns false if they don't fit.
+  const auto pack_page = [&](const std::vector<std::size_t>& par_members, page& par_page) {
+    std::uint64_t total = 0;
+    for (const auto member : par_members) {
+      total += area(member);
+    }
+    if (total > static_cast<std::uint64_t>(page_size) * page_size) {
+      return false;
+    }
+
+    txpk::RectanglePtrs rectangles;
+    rectangles.reserve(par_members.size());
+    for (const auto member : par_members) {
+      const auto bounds = textures_[member]->getBounds();
+      rectangles.push_back(
+          std::make_shared<txpk::Rectangle>(0, 0, bounds->width, bounds->height));
+    }
+
+    txpk::Bin const bin = page_packer->pack(rectangles, page_size,
+                                            txpk::SizeContraintType::Width, allow_rotation_);
+    if (bin.width == 0 || bin.width > page_size || bin.height > page_size) {
+      return false;
+    }
+
+    par_page.width = bin.width;
+    par_page.height = bin.height;
+    par_page.placements.clear();
+    for (std::size_t i = 0; i < par_members.size(); i++) {
+      par_page.placements.push_back({par_members[i], rectangles[i]->left, rectangles[i]->top,
+                                     rectangles[i]->isRotated()});
+    }
+    return true;
+  };
+
+  for (std::size_t i = 0; i < textures_.size(); i++) {
+    const auto bounds = textures_[i]->getBounds();
+    if (bounds->width > page_size || bounds->height > page_size) {
+      spdlog::error("'{}' ({}x{}) is larger than the page size {}", textures_[i]->name,
+                    bounds->width, bounds->height, page_size);
+      return false;
+    }
+  }
+
+  // Textures that never got added as part of a group form their own.
+  std::vector<std::vector<std::size_t>> groups = groups_;
+  std::vector<bool> grouped(textures_.size(), false);
+  for (const auto& group : groups) {
+    for (const auto member : group) {
+      grouped[member] = true;
+    }
+  }
+  for (std::size_t i = 0; i < textures_.size(); i++) {
+    if (!grouped[i]) {
+      groups.push_back({i});
+    }
+  }
+
+  // Big groups first, the small ones fill the gaps they leave.
+  std::vector<std::uint64_t> group_area(groups.size(), 0);
+  for (std::size_t i = 0; i < groups.size(); i++) {
+    for (const auto member : groups[i]) {
+      group_area[i] += area(member);
+    }
+  }
+  std::vector<std::size_t> order(groups.size());
+  for (std::size_t i = 0; i < order.size(); i++) {
+    order[i] = i;
+  }
+  std::stable_sort(order.begin(), order.end(), [&](std::size_t par_a, std::size_t par_b) {
+    return group_area[par_a] > group_area[par_b];
+  });
+
+  // New pages go after the ones of a loaded atlas, those stay as they are.
+  const std::size_t first_page = pages_.size();
+  std::vector<std::vector<std::size_t>> members;
+  const auto missing = [&members](std::size_t par_page, const std::vector<std::size_t>& par_group) {
+    std::vector<std::size_t> result;
+    for (const auto member : par_group) {
+      if (std::find(members[par_page].begin(), members[par_page].end(), member) ==
+          members[par_page].end()) {
+        result.push_back(member);
+      }
+    }
+    return result;
+  };
+
+  // Places par_add into the free space of page par_index, what it holds already stays where it
+  // is. The page may grow up to page_size.
+  const auto insert_into_page = [&](std::size_t par_index,
+                                    const std::vector<std::size_t>& par_add) {
+    std::uint64_t total = 0;
+    for (const auto member : members[par_index]) {
+      total += area(member);
+    }
+    for (const auto member : par_add) {
+      total += area(member);
+    }
+    if (total > static_cast<std::uint64_t>(page_size) * page_size) {
+      return false;
+    }
+
+    page& target = pages_[first_page + par_index];
+    txpk::RectanglePtrs fixed;
+    fixed.reserve(target.placements.size());
+    for (const auto& place : target.placements) {
+      const auto bounds = textures_[place.texture]->getBounds();
+      const std::uint32_t width = place.rotated ? bounds->height : bounds->width;
+      const std::uint32_t height = place.rotated ? bounds->width : bounds->height;
+      fixed.push_back(std::make_shared<txpk::Rectangle>(place.left, place.top,
+                                                        place.left + width, place.top + height));
+    }
+
+    txpk::RectanglePtrs rectangles;
+    rectangles.reserve(par_add.size());
+    for (const auto member : par_add) {
+      const auto bounds = textures_[member]->getBounds();
+      rectangles.push_back(
+          std::make_shared<txpk::Rectangle>(0, 0, bounds->width, bounds->height));
+    }
+
+    std::uint32_t width = target.width;
+    std::uint32_t height = target.height;
+    if (!page_packer->pack_around(fixed, rectangles, width, height, allow_rotation_,
+                                  page_size)) {
+      return false;
+    }
+
+    target.width = width;
+    target.height = height;
+    for (std::size_t i = 0; i < par_add.size(); i++) {
+      target.placements.push_back({par_add[i], rectangles[i]->left, rectangles[i]->top,
+                                   rectangles[i]->isRotated()});
+    }
+    members[par_index].insert(members[par_index].end(), par_add.begin(), par_add.end());
+    return true;
+  };
+
+  // Tries to add par_group to one of the existing pages, those that already have most of it
+  // first.
+  const auto add_to_page = [&](const std::vector<std::size_t>& par_group) {
+    std::vector<std::pair<std::size_t, std::size_t>> candidates;  // missing count, page
+    for (std::size_t i = 0; i < members.size(); i++) {
+      candidates.emplace_back(missing(i, par_group).size(), i);
+    }
+    std::sort(candidates.begin(), candidates.end());
+
+    for (const auto& [count, index] : candidates) {
+      if (count == 0 || insert_into_page(index, missing(index, par_group))) {
+        return true;
+      }
+    }
+
+    // Packing a page from scratch can still fit the group where the free space couldn't. That
+    // runs every heuristic over the whole page, so only the pages with most of the group try.
+    constexpr std::size_t kRepackPages = 2;
+    for (std::size_t i = 0; i < std::min(kRepackPages, candidates.size()); i++) {
+      const std::size_t index = candidates[i].second;
+      auto merged = members[index];
+      const auto add = missing(index, par_group);
+      merged.insert(merged.end(), add.begin(), add.end());
+
+      page candidate;
+      if (pack_page(merged, candidate)) {
+        members[index] = std::move(merged);
+        pages_[first_page + index] = std::move(candidate);
+        return true;
+      }
+    }
+
+    page candidate;
+    if (pack_page(par_group, candidate)) {
+      members.push_back(par_group);
+      pages_.push_back(std::move(candidate));
+      return true;
+    }
+
+    return false;
+  };
+
+  for (const auto index : order) {
+    if (add_to_page(groups[index])) {
+      continue;
+    }
+
+    // The group is larger than a page, spread it texture by texture.
+    spdlog::warn("The textures of one model don't fit on a single {0}x{0} page", page_size);
+    for (const auto member : groups[index]) {
+      if (!add_to_page({member})) {
+        return false;
+      }
+    }
+  }
+
+  if (pages_.empty()) {
+    pages_.push_back({0, 0, {}});
+  }
+
+  spdlog::info("Packed the atlas into {} page(s)", pages_.size());
   return true;
 }
 
@@ -168,20 +687,27 @@ void atlas::info(atlas_info& par_info) { info_ = par_info; }
 
 const atlas_info& atlas::info() const { return info_; }
 
-bool atlas::save(const std::string& par_savepath) {
+bool atlas::save(const std::string& par_savepath, dxt::Quality par_quality) {
   if (!packed_ && !pack()) {
     return false;
   }
 
-  const txpk::Color<4U> black{};
   std::filesystem::path yaml_path(par_savepath);
-  auto color_path = (yaml_path.parent_path() / (yaml_path.stem().string() + "_tex1.dds")).string();
-  bool const result = bin_.save(textures_, black, color_path, false);
-  if (!result) {
-    return result;
-  }
 
-  info_.color_image = color_path;
+  for (std::size_t page = 0; page < pages_.size(); page++) {
+    // The first page keeps the name single page atlases always had.
+    const std::string suffix = page == 0 ? "_tex1.dds" : fmt::format("_page{}_tex1.dds", page);
+    auto color_path = (yaml_path.parent_path() / (yaml_path.stem().string() + suffix)).string();
+    if (!save_page_(color_path, page, par_quality)) {
+      return false;
+    }
+
+    if (page == 0) {
+      info_.color_image = color_path;
+    } else {
+      info_.extra_pages[page - 1].color_image = color_path;
+    }
+  }
 
   // Generate fake other.dds
   Image other_image;
@@ -218,14 +744,302 @@ bool atlas::save(const std::string& par_savepath) {
     spdlog::error("Failed to save the yaml file");
   }
 
-  return result;
+  // The index gets written last so it is never older than the yaml it belongs to.
+  auto index_path = std::filesystem::path(yaml_path).replace_extension(".atlasidx").string();
+  if (!info_.save_index(index_path)) {
+    spdlog::error("Failed to save the atlas index '{}'", index_path);
+  }
+
+  return true;
+}
+
+std::string atlas::lossless_path(const std::string& par_color_image) {
+  return std::filesystem::path(par_color_image).replace_extension(".tga").string();
+}
+
+namespace {
+
+// Writes an uncompressed 32 bit TGA row by row, top row first.
+class tga_writer {
+ public:
+  ~tga_writer() {
+    if (fp_ != nullptr) {
+      fclose(fp_);
+    }
+  }
+
+  bool open(const std::string& par_path, std::uint32_t par_width, std::uint32_t par_height) {
+    if (par_width > 0xFFFF || par_height > 0xFFFF) {
+      return false;
+    }
+
+    fp_ = fopen(par_path.c_str(), "wb");
+    if (fp_ == nullptr) {
+      return false;
+    }
+
+    width_ = par_width;
+    std::uint8_t header[18] = {};
+    header[2] = 2;  // uncompressed true color
+    header[12] = par_width & 0xFF;
+    header[13] = par_width >> 8;
+    header[14] = par_height & 0xFF;
+    header[15] = par_height >> 8;
+    header[16] = 32;
+    header[17] = 0x20 | 8;  // top left origin, 8 alpha bits
+    return fwrite(header, sizeof(header), 1, fp_) == 1;
+  }
+
+  bool write_rows(const txpk::Color4* par_rows, std::uint32_t par_count) {
+    row_.resize(static_cast<std::size_t>(width_) * 4);
+    for (std::uint32_t y = 0; y < par_count; y++) {
+      const auto* src = reinterpret_cast<const std::uint8_t*>(par_rows + y * width_);
+      for (std::uint32_t x = 0; x < width_; x++) {
+        row_[x * 4 + 0] = src[x * 4 + 2];
+        row_[x * 4 + 1] = src[x * 4 + 1];
+        row_[x * 4 + 2] = src[x * 4 + 0];
+        row_[x * 4 + 3] = src[x * 4 + 3];
+      }
+      if (fwrite(row_.data(), row_.size(), 1, fp_) != 1) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  bool close() {
+    const bool ok = fclose(fp_) == 0;
+    fp_ = nullptr;
+    return ok;
+  }
+
+ private:
+  FILE* fp_ = nullptr;
+  std::uint32_t width_ = 0;
+  std::vector<std::uint8_t> row_;
+};
+
+// Reads what tga_writer wrote row by row, top row first.
+class tga_reader {
+ public:
+  ~tga_reader() {
+    if (fp_ != nullptr) {
+      fclose(fp_);
+    }
+  }
+
+  bool open(const std::string& par_path) {
+    fp_ = fopen(par_path.c_str(), "rb");
+    if (fp_ == nullptr) {
+      return false;
+    }
+
+    std::uint8_t header[18];
+    if (fread(header, sizeof(header), 1, fp_) != 1 || header[0] != 0 || header[1] != 0 ||
+        header[2] != 2 || header[16] != 32 || (header[17] & 0x20) == 0) {
+      return false;
+    }
+
+    width_ = header[12] | (header[13] << 8);
+    height_ = header[14] | (header[15] << 8);
+    return true;
+  }
+
+  std::uint32_t width() const { return width_; }
+  std::uint32_t height() const { return height_; }
+
+  void close() {
+    if (fp_ != nullptr) {
+      fclose(fp_);
+      fp_ = nullptr;
+    }
+  }
+
+  bool read_row(txpk::Color4* par_row) {
+    row_.resize(static_cast<std::size_t>(width_) * 4);
+    if (fread(row_.data(), row_.size(), 1, fp_) != 1) {
+      return false;
+    }
+
+    auto* dst = reinterpret_cast<std::uint8_t*>(par_row);
+    for (std::uint32_t x = 0; x < width_; x++) {
+      dst[x * 4 + 0] = row_[x * 4 + 2];
+      dst[x * 4 + 1] = row_[x * 4 + 1];
+      dst[x * 4 + 2] = row_[x * 4 + 0];
+      dst[x * 4 + 3] = row_[x * 4 + 3];
+    }
+    return true;
+  }
+
+ private:
+  FILE* fp_ = nullptr;
+  std::uint32_t width_ = 0;
+  std::uint32_t height_ = 0;
+  std::vector<std::uint8_t> row_;
+};
+
+}  // namespace
+
+bool atlas::save_page_(const std::string& par_path, std::size_t par_page,
+                       dxt::Quality par_quality) {
+  const page& bin = pages_[par_page];
+
+  // The fixed part of an incrementally updated atlas. Its lossless copy gets read strip by strip
+  // along with the tiles below, decoding the DDS and compressing it again would lose quality on
+  // every update. Without one the DDS is loaded whole, flipped into the row order the bin uses.
+  tga_reader fixed_reader;
+  std::uint32_t fixed_width = 0;
+  std::uint32_t fixed_height = 0;
+  std::shared_ptr<Image> fixed_image;
+  const txpk::Color4* fixed_data = nullptr;
+  if (par_page < fixed_images_.size()) {
+    const std::string source = lossless_path(fixed_images_[par_page]);
+    if (std::filesystem::exists(source) && fixed_reader.open(source)) {
+      fixed_width = fixed_reader.width();
+      fixed_height = fixed_reader.height();
+    } else {
+      spdlog::warn("'{}' is missing, starting from the compressed '{}'", source,
+                   fixed_images_[par_page]);
+
+      fixed_image = std::make_shared<Image>();
+      if (!fixed_image->load(fixed_images_[par_page]) ||
+          !fixed_image->to_origin(ImageOrigin::LowerLeft)) {
+        spdlog::error("Failed to load the existing atlas '{}': {}", fixed_images_[par_page],
+                      fixed_image->error());
+        return false;
+      }
+      fixed_image->add_alpha();
+
+      if (fixed_image->bpp() != 4) {
+        spdlog::error("The existing atlas '{}' isn't RGBA", fixed_images_[par_page]);
+        return false;
+      }
+
+      fixed_width = static_cast<std::uint32_t>(fixed_image->width());
+      fixed_height = static_cast<std::uint32_t>(fixed_image->height());
+      fixed_data = reinterpret_cast<const txpk::Color4*>(fixed_image->data());
+    }
+
+    if (fixed_width > bin.width || fixed_height > bin.height) {
+      spdlog::error("The existing atlas '{}' doesn't match its yaml", fixed_images_[par_page]);
+      return false;
+    }
+  }
+
+  dxt::DdsWriter writer;
+  if (!writer.open(par_path, bin.width, bin.height, 4, dxt::Format::BC3, par_quality)) {
+    spdlog::error("tex1.dds create failed");
+    return false;
+  }
+
+  // Written next to the lossless copy that is being read, it replaces that one at the end.
+  const std::string lossless = lossless_path(par_path);
+  const std::string lossless_tmp = lossless + ".tmp";
+  tga_writer lossless_writer;
+  if (lossless_ && !lossless_writer.open(lossless_tmp, bin.width, bin.height)) {
+    spdlog::error("Failed to create '{}'", lossless_tmp);
+    return false;
+  }
+
+  // Compose and compress the atlas in strips of rows, only the textures that intersect a strip get
+  // copied into it. Bin row y ends up as row height - 1 - y of the file, like txpk::Bin::save with
+  // DevIL's lower left origin. The fixed image's file rows are the last fixed_height of them.
+  constexpr std::uint32_t kTileRows = 256;
+  std::vector<txpk::Color4> tile;
+  for (std::uint32_t file_row = 0; file_row < bin.height; file_row += kTileRows) {
+    const std::uint32_t rows = std::min(kTileRows, bin.height - file_row);
+    const std::uint32_t bin_first = bin.height - file_row - rows;
+    const std::uint32_t bin_last = bin.height - file_row;  // exclusive
+
+    tile.assign(static_cast<std::size_t>(rows) * bin.width, txpk::Color4{});
+    const auto tile_row = [&](std::uint32_t par_bin_row) {
+      return &tile[static_cast<std::size_t>(bin_last - 1 - par_bin_row) * bin.width];
+    };
+
+    if (fixed_data != nullptr) {
+      for (std::uint32_t y = bin_first; y < std::min(bin_last, fixed_height); y++) {
+        std::memcpy(tile_row(y), &fixed_data[static_cast<std::size_t>(y) * fixed_width],
+                    fixed_width * sizeof(txpk::Color4));
+      }
+    } else if (fixed_height > 0) {
+      for (std::uint32_t y = std::min(bin_last, fixed_height); y-- > bin_first;) {
+        if (!fixed_reader.read_row(tile_row(y))) {
+          spdlog::error("Failed to read '{}'", lossless_path(fixed_images_[par_page]));
+          return false;
+        }
+      }
+    }
+
+    for (const auto& place : bin.placements) {
+      txpk::RectanglePtr const bounds = textures_[place.texture]->getBounds();
+      const std::uint32_t width = bounds->width;
+      const std::uint32_t height = bounds->height;
+      const std::uint32_t first = std::max(place.top, bin_first);
+      const std::uint32_t last = std::min(place.top + (place.rotated ? width : height), bin_last);
+      if (first >= last) {
+        continue;
+      }
+
+      const auto& pixels = textures_[place.texture]->getRawPixelData();
+      for (std::uint32_t y = first; y < last; y++) {
+        if (!place.rotated) {
+          std::memcpy(tile_row(y) + place.left, &pixels[(y - place.top) * width],
+                      width * sizeof(txpk::Color4));
+          continue;
+        }
+
+        // Turned counter clockwise, the row holds the texture's column width - 1 - row.
+        const std::uint32_t column = width - 1 - (y - place.top);
+        txpk::Color4* row = tile_row(y) + place.left;
+        for (std::uint32_t x = 0; x < height; x++) {
+          row[x] = pixels[x * width + column];
+        }
+      }
+    }
+
+    if (!writer.write_rows(reinterpret_cast<const std::uint8_t*>(tile.data()), rows)) {
+      spdlog::error("tex1.dds save failed");
+      return false;
+    }
+    if (lossless_ && !lossless_writer.write_rows(tile.data(), rows)) {
+      spdlog::error("Failed to write '{}'", lossless_tmp);
+      return false;
+    }
+  }
+  if (!writer.close()) {
+    spdlog::error("tex1.dds save failed");
+    return false;
+  }
+
+  fixed_reader.close();
+  std::error_code err;
+  if (!lossless_) {
+    // A copy older than the DDS would be picked up by the next update.
+    std::filesystem::remove(lossless, err);
+    return true;
+  }
+
+  if (!lossless_writer.close()) {
+    spdlog::error("Failed to write '{}'", lossless_tmp);
+    return false;
+  }
+
+  std::filesystem::rename(lossless_tmp, lossless, err);
+  if (err) {
+    spdlog::error("Failed to replace '{}', error was: {}", lossless, err.message());
+    return false;
+  }
+
+  return true;
 }
 
 std::optional<atlas_info> atlas_info::load(const std::string& par_path) {
   YAML::Node config;
   try {
     config = YAML::LoadFile(par_path);
-    return config.as<atlas_info>();
+    auto result = config.as<atlas_info>();
+    result.build_index();
+    return result;
   } catch (const std::exception& err) {
     spdlog::error("Failed to load '{}', error was: '{}'", par_path, err.what());
     return std::nullopt;
@@ -248,6 +1062,252 @@ bool atlas_info::save(const std::string& par_path) {
   return true;
 }
 
+namespace {
+
+constexpr char kIndexMagic[4] = {'U', 'P', 'A', 'I'};
+constexpr std::uint32_t kIndexVersion = 5;
+
+// All offsets are relative to the start of the name block, which follows the entries and the
+// extra pages.
+struct atlas_index_header {
+  char magic[4];
+  std::uint32_t version;
+  std::uint32_t width;
+  std::uint32_t height;
+  std::uint32_t margin;
+  std::uint32_t count;
+  std::uint32_t extra_page_count;
+  std::uint32_t names_size;
+  std::uint32_t image_offset[3];  // color, other, normal
+  std::uint32_t image_length[3];
+};
+
+struct atlas_index_entry {
+  std::uint32_t name_offset;
+  std::uint32_t name_length;
+  std::uint32_t width;
+  std::uint32_t height;
+  std::uint32_t orig_width;
+  std::uint32_t orig_height;
+  std::uint32_t left;
+  std::uint32_t top;
+  std::uint32_t page;
+  std::uint32_t rotated;
+};
+
+struct atlas_index_page {
+  std::uint32_t image_offset;
+  std::uint32_t image_length;
+  std::uint32_t width;
+  std::uint32_t height;
+};
+
+}  // namespace
+
+std::optional<atlas_info> atlas_info::load_index(const std::string& par_path) {
+  FILE* fp = fopen(par_path.c_str(), "rb");
+  if (fp == nullptr) {
+    return std::nullopt;
+  }
+
+  fseek(fp, 0, SEEK_END);
+  const long len = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+  std::vector<std::uint8_t> buf(len > 0 ? len : 0);
+  const bool read = !buf.empty() && fread(buf.data(), buf.size(), 1, fp) == 1;
+  fclose(fp);
+
+  atlas_index_header header;
+  if (!read || buf.size() < sizeof(header)) {
+    spdlog::warn("Ignoring truncated atlas index '{}'", par_path);
+    return std::nullopt;
+  }
+  std::memcpy(&header, buf.data(), sizeof(header));
+
+  const std::size_t pages_start = sizeof(header) + header.count * sizeof(atlas_index_entry);
+  const std::size_t names_start =
+      pages_start + header.extra_page_count * sizeof(atlas_index_page);
+  if (std::memcmp(header.magic, kIndexMagic, sizeof(kIndexMagic)) != 0 ||
+      header.version != kIndexVersion || buf.size() != names_start + header.names_size) {
+    spdlog::warn("Ignoring invalid atlas index '{}'", par_path);
+    return std::nullopt;
+  }
+
+  const char* names = reinterpret_cast<const char*>(buf.data() + names_start);
+  const auto name_at = [&](std::uint32_t par_offset,
+                           std::uint32_t par_length) -> std::optional<std::string> {
+    if (static_cast<std::uint64_t>(par_offset) + par_length > header.names_size) {
+      return std::nullopt;
+    }
+    return std::string(names + par_offset, par_length);
+  };
+
+  atlas_info result;
+  result.width = header.width;
+  result.height = header.height;
+  result.margin = header.margin;
+
+  std::string* images[3] = {&result.color_image, &result.other_image, &result.normal_image};
+  for (int i = 0; i < 3; i++) {
+    auto image = name_at(header.image_offset[i], header.image_length[i]);
+    if (!image) {
+      spdlog::warn("Ignoring invalid atlas index '{}'", par_path);
+      return std::nullopt;
+    }
+    *images[i] = std::move(*image);
+  }
+
+  result.extra_pages.reserve(header.extra_page_count);
+  for (std::uint32_t i = 0; i < header.extra_page_count; i++) {
+    atlas_index_page page;
+    std::memcpy(&page, buf.data() + pages_start + i * sizeof(page), sizeof(page));
+
+    auto image = name_at(page.image_offset, page.image_length);
+    if (!image) {
+      spdlog::warn("Ignoring invalid atlas index '{}'", par_path);
+      return std::nullopt;
+    }
+    result.extra_pages.push_back({std::move(*image), page.width, page.height});
+  }
+
+  result.textures.reserve(header.count);
+  for (std::uint32_t i = 0; i < header.count; i++) {
+    atlas_index_entry entry;
+    std::memcpy(&entry, buf.data() + sizeof(header) + i * sizeof(entry), sizeof(entry));
+
+    auto name = name_at(entry.name_offset, entry.name_length);
+    if (!name) {
+      spdlog::warn("Ignoring invalid atlas index '{}'", par_path);
+      return std::nullopt;
+    }
+
+    result.textures.emplace_back(*name, entry.width, entry.height, entry.orig_width,
+                                 entry.orig_height, entry.left, entry.top, entry.page,
+                                 entry.rotated != 0);
+  }
+
+  result.build_index();
+
+  return result;
+}
+
+bool atlas_info::save_index(const std::string& par_path) const {
+  std::string names;
+  const auto add_name = [&names](const std::string& par_name) {
+    const auto offset = static_cast<std::uint32_t>(names.size());
+    names += par_name;
+    return offset;
+  };
+
+  atlas_index_header header{};
+  std::memcpy(header.magic, kIndexMagic, sizeof(kIndexMagic));
+  header.version = kIndexVersion;
+  header.width = width;
+  header.height = height;
+  header.margin = margin;
+  header.count = static_cast<std::uint32_t>(textures.size());
+  header.extra_page_count = static_cast<std::uint32_t>(extra_pages.size());
+
+  const std::string* images[3] = {&color_image, &other_image, &normal_image};
+  for (int i = 0; i < 3; i++) {
+    header.image_offset[i] = add_name(*images[i]);
+    header.image_length[i] = static_cast<std::uint32_t>(images[i]->size());
+  }
+
+  std::vector<atlas_index_entry> entries;
+  entries.reserve(textures.size());
+  for (const auto& texture : textures) {
+    entries.push_back({add_name(texture.name), static_cast<std::uint32_t>(texture.name.size()),
+                       texture.width, texture.height, texture.orig_width, texture.orig_height,
+                       texture.left, texture.top, texture.page, texture.rotated ? 1U : 0U});
+  }
+
+  std::vector<atlas_index_page> pages;
+  pages.reserve(extra_pages.size());
+  for (const auto& page : extra_pages) {
+    pages.push_back({add_name(page.color_image),
+                     static_cast<std::uint32_t>(page.color_image.size()), page.width,
+                     page.height});
+  }
+  header.names_size = static_cast<std::uint32_t>(names.size());
+
+  FILE* fp = fopen(par_path.c_str(), "wb");
+  if (fp == nullptr) {
+    return false;
+  }
+
+  bool result = fwrite(&header, sizeof(header), 1, fp) == 1;
+  if (result && !entries.empty()) {
+    result = fwrite(entries.data(), sizeof(atlas_index_entry), entries.size(), fp) ==
+             entries.size();
+  }
+  if (result && !pages.empty()) {
+    result = fwrite(pages.data(), sizeof(atlas_index_page), pages.size(), fp) == pages.size();
+  }
+  if (result && !names.empty()) {
+    result = fwrite(names.data(), names.size(), 1, fp) == 1;
+  }
+  fclose(fp);
+
+  return result;
+}
+
+atlas_page atlas_info::page(std::uint32_t par_page) const {
+  if (par_page == 0) {
+    return {color_image, width, height};
+  }
+  return extra_pages.at(par_page - 1);
+}
+
+void atlas_info::build_index() {
+  index.clear();
+  index.reserve(textures.size());
+
+  for (std::size_t i = 0; i < textures.size(); i++) {
+    auto& positions = index[to_lower(textures[i].name)];
+
+    // The first entry of a name on a page wins, later duplicates are ignored.
+    auto it_page = std::find_if(positions.begin(), positions.end(), [&](std::size_t par_other) {
+      return textures[par_other].page == textures[i].page;
+    });
+    if (it_page == positions.end()) {
+      positions.push_back(i);
+    }
+  }
+}
+
+const atlas_info_image* atlas_info::find(const std::string& par_name) const {
+  return find(par_name, std::nullopt);
+}
+
+const atlas_info_image* atlas_info::find(const std::string& par_name,
+                                         std::uint32_t par_page) const {
+  return find(par_name, std::optional<std::uint32_t>(par_page));
+}
+
+const atlas_info_image* atlas_info::find(const std::string& par_name,
+                                         std::optional<std::uint32_t> par_page) const {
+  auto name = to_lower(par_name);
+
+  // Like the linear scan this replaces, the first entry named either par_name or par_name + "00"
+  // wins.
+  std::optional<std::size_t> best;
+  for (const auto& key : {name, name + "00"}) {
+    auto it_index = index.find(key);
+    if (it_index == index.end()) {
+      continue;
+    }
+
+    for (const auto position : it_index->second) {
+      if ((!par_page || textures[position].page == *par_page) && (!best || position < *best)) {
+        best = position;
+      }
+    }
+  }
+
+  return best ? &textures[*best] : nullptr;
+}
+
 namespace YAML {
 template <>
 struct convert<atlas_info> {
@@ -258,7 +1318,11 @@ struct convert<atlas_info> {
     node["normal_image"] = rhs.normal_image;
     node["width"] = rhs.width;
     node["height"] = rhs.height;
+    node["margin"] = rhs.margin;
     node["textures"] = rhs.textures;
+    if (!rhs.extra_pages.empty()) {
+      node["extra_pages"] = rhs.extra_pages;
+    }
     return node;
   }
 
@@ -282,9 +1346,44 @@ struct convert<atlas_info> {
     if (node["height"]) {
       rhs.height = node["height"].as<std::uint32_t>();
     }
+    if (node["margin"]) {
+      rhs.margin = node["margin"].as<std::uint32_t>();
+    }
     if (node["textures"]) {
       rhs.textures = node["textures"].as<std::vector<atlas_info_image>>();
     }
+    if (node["extra_pages"]) {
+      rhs.extra_pages = node["extra_pages"].as<std::vector<atlas_page>>();
+    }
+
+    return true;
+  }
+};
+
+template <>
+struct convert<atlas_page> {
+  static Node encode(const atlas_page& rhs) {
+    Node node;
+    node["color_image"] = rhs.color_image;
+    node["width"] = rhs.width;
+    node["height"] = rhs.height;
+    return node;
+  }
+
+  static bool decode(const Node& node, atlas_page& rhs) {
+    if (!node.IsMap()) {
+      return false;
+    }
+
+    if (node["color_image"]) {
+      rhs.color_image = node["color_image"].as<std::string>();
+    }
+    if (node["width"]) {
+      rhs.width = node["width"].as<std::uint32_t>();
+    }
+    if (node["height"]) {
+      rhs.height = node["height"].as<std::uint32_t>();
+    }
 
     return true;
   }
@@ -301,6 +1400,12 @@ struct convert<atlas_info_image> {
     node["orig_height"] = rhs.orig_height;
     node["left"] = rhs.left;
     node["top"] = rhs.top;
+    if (rhs.page != 0) {
+      node["page"] = rhs.page;
+    }
+    if (rhs.rotated) {
+      node["rotated"] = rhs.rotated;
+    }
     return node;
   }
 
@@ -331,6 +1436,12 @@ struct convert<atlas_info_image> {
     if (node["top"]) {
       rhs.top = node["top"].as<std::uint32_t>();
     }
+    if (node["page"]) {
+      rhs.page = node["page"].as<std::uint32_t>();
+    }
+    if (node["rotated"]) {
+      rhs.rotated = node["rotated"].as<bool>();
+    }
 
     return true;
   }
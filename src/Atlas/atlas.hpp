@@ -4,37 +4,49 @@
 #include <string>
 #include <memory>
 #include <optional>
+#include <unordered_map>
 #include "../Image.h"
 #include "../Texture.h"
 
 #include <TXPK/Core/IPacker.hpp>
 
-#define ATLAS_MARGIN 0
-
 struct atlas_info_image {
   atlas_info_image(){};
   atlas_info_image(std::string& par_name, std::uint32_t par_width, std::uint32_t par_height,
                    std::uint32_t par_orig_width, std::uint32_t par_orig_height,
-                   std::uint32_t par_left, std::uint32_t par_top)
+                   std::uint32_t par_left, std::uint32_t par_top, std::uint32_t par_page = 0,
+                   bool par_rotated = false)
       : name(par_name),
         width(par_width),
         height(par_height),
         orig_width(par_orig_width),
         orig_height(par_orig_height),
         left(par_left),
-        top(par_top) {}
+        top(par_top),
+        page(par_page),
+        rotated(par_rotated) {}
 
   std::string name;
+  // Size of the rect in the atlas, orig_width/orig_height are the texture's own.
   std::uint32_t width;
   std::uint32_t height;
   std::uint32_t orig_width;
   std::uint32_t orig_height;
   std::uint32_t left;
   std::uint32_t top;
+  std::uint32_t page = 0;
+  // Turned by 90 degrees counter clockwise (Texture::adjustRotation), the texture's v runs along
+  // the atlas u and its u against the atlas v.
+  bool rotated = false;
 
-  inline float U(std::uint32_t par_width, float par_u) {
-    float result = par_u * float(orig_width) / float(par_width) +
-                   (float(left) + float(ATLAS_MARGIN)) / float(par_width);
+  // par_u/par_v are the texture's own coordinates, par_margin is the padding around every
+  // texture, see atlas_info::margin. They span orig_width x orig_height pixels from the top left
+  // of the content, which can be larger (padded to power of two). Rotated textures get flipped
+  // against the content width, that is the rect's height without the margin.
+  inline float U(std::uint32_t par_width, std::uint32_t par_margin, float par_u,
+                 float par_v) const {
+    const float offset = rotated ? par_v * float(orig_height) : par_u * float(orig_width);
+    float result = (offset + float(left) + float(par_margin)) / float(par_width);
     if (result > 1.0f) {
       return 1.0f;
     }
@@ -44,9 +56,12 @@ struct atlas_info_image {
     return result;
   }
 
-  inline float V(std::uint32_t par_height, float par_v) {
-    float result = par_v * float(orig_height) / float(par_height) +
-                   (float(top) + float(ATLAS_MARGIN)) / float(par_height);
+  inline float V(std::uint32_t par_height, std::uint32_t par_margin, float par_u,
+                 float par_v) const {
+    const float content_width = float(height) - 2.0f * float(par_margin);
+    const float offset =
+        rotated ? content_width - par_u * float(orig_width) : par_v * float(orig_height);
+    float result = (offset + float(top) + float(par_margin)) / float(par_height);
     if (result > 1.0f) {
       return 1.0f;
     }
@@ -57,16 +72,60 @@ struct atlas_info_image {
   }
 };
 
+struct atlas_page {
+  std::string color_image;
+  std::uint32_t width;
+  std::uint32_t height;
+};
+
 struct atlas_info {
   std::string color_image;
   std::string other_image;
   std::string normal_image;
   std::uint32_t width;
   std::uint32_t height;
+  // Pixels around every texture filled with its extruded edges, so filtering and mipmaps don't
+  // bleed in the neighbours. The rects (left, top, width, height) include it.
+  std::uint32_t margin = 0;
   std::vector<atlas_info_image> textures;
+  // Pages after the first one, which is color_image, width and height.
+  std::vector<atlas_page> extra_pages;
+
+  // Lowercase name -> positions in textures, one per page the texture is on, see build_index().
+  std::unordered_map<std::string, std::vector<std::size_t>> index;
+
+  std::uint32_t page_count() const { return 1 + static_cast<std::uint32_t>(extra_pages.size()); }
+  atlas_page page(std::uint32_t par_page) const;
 
   static std::optional<atlas_info> load(const std::string& par_path);
   bool save(const std::string& par_path);
+
+  /**
+   * Binary sidecar of the YAML file, fixed size records in the order of textures followed by the
+   * names. Much cheaper to load than the YAML, which stays the editable source.
+   */
+  static std::optional<atlas_info> load_index(const std::string& par_path);
+  bool save_index(const std::string& par_path) const;
+
+  /**
+   * Rebuilds index, needs to be called after textures changed.
+   */
+  void build_index();
+
+  /**
+   * Looks up par_name or par_name + "00" case insensitive, the first of them in textures wins.
+   * Returns nullptr when the atlas doesn't contain it.
+   */
+  const atlas_info_image* find(const std::string& par_name) const;
+
+  /**
+   * As above, but only looks at the textures on par_page.
+   */
+  const atlas_info_image* find(const std::string& par_name, std::uint32_t par_page) const;
+
+ private:
+  const atlas_info_image* find(const std::string& par_name,
+                               std::optional<std::uint32_t> par_page) const;
 };
 
 class atlas {
@@ -75,29 +134,136 @@ class atlas {
   ~atlas() = default;
 
   atlas(const atlas& rhs) {
+    packed_ = false;
     packer_ = rhs.packer_;
     textures_ = rhs.textures_;
-    bin_ = rhs.bin_;
+    copies_ = rhs.copies_;
+    names_ = rhs.names_;
+    content_hashes_ = rhs.content_hashes_;
+    aliases_ = rhs.aliases_;
+    groups_ = rhs.groups_;
+    max_page_size_ = rhs.max_page_size_;
+    allow_rotation_ = rhs.allow_rotation_;
+    lossless_ = rhs.lossless_;
+    pages_ = rhs.pages_;
+    info_ = rhs.info_;
+    fixed_ = rhs.fixed_;
+    fixed_images_ = rhs.fixed_images_;
   }
 
+  /**
+   * Loads the atlas info, the textures it already holds keep their place when new ones get
+   * added and packed, save() then starts from the existing color image. That is the lossless
+   * copy of every page (see lossless()) if the atlas has one, otherwise the DDS.
+   */
   bool load_yaml(const std::string& par_path);
 
   static atlas make_from_archive(const std::string& par_archive, const std::string& par_savepath,
                                  bool par_power_of_two);
 
-  bool add_3do_textures(std::vector<ImagePtr> par_images, bool par_power_of_two);
+  /**
+   * Margin for the textures added from now on, can't be changed for a loaded atlas.
+   */
+  bool margin(std::uint32_t par_margin);
+  std::uint32_t margin() const { return info_.margin; }
+
+  /**
+   * Limits every page to par_size x par_size pixels, textures that don't fit spill onto more
+   * pages. The textures added together (one model) are kept on as few pages as possible, a
+   * texture used by models on different pages gets a copy on each of them.
+   * 0 (default) packs everything into a single page of any size.
+   */
+  void max_page_size(std::uint32_t par_size);
+  std::uint32_t max_page_size() const { return max_page_size_; }
+
+  /**
+   * Makes save() write an uncompressed TGA next to every page (see lossless_path()), later
+   * incremental updates start from it instead of recompressing the DDS. It takes 4 bytes per
+   * pixel, so it's off by default. load_yaml() turns it on when the loaded atlas has one.
+   */
+  void lossless(bool par_lossless) { lossless_ = par_lossless; }
+  bool lossless() const { return lossless_; }
+
+  /**
+   * Lets pack() turn textures by 90 degrees where that packs tighter, off by default.
+   */
+  void allow_rotation(bool par_allow);
+  bool allow_rotation() const { return allow_rotation_; }
+
+  bool add_3do_textures(const std::vector<std::shared_ptr<Texture>>& par_textures,
+                        bool par_power_of_two);
   bool add_textures(std::vector<ImagePtr> par_images);
 
+  /**
+   * Selects the packer pack() uses:
+   * - "maxrects" (default), smallest bin of several heuristics tried in parallel.
+   * - "maxrects_pow2", as above but compares the bins rounded to power of two sizes.
+   * - "blackspawn", the old TXPK packer.
+   */
+  bool packer(const std::string& par_name);
+
   bool pack();
   void info(atlas_info& par_info);
   const atlas_info& info() const;
-  bool save(const std::string& par_savepath);
+  bool save(const std::string& par_savepath, dxt::Quality par_quality = dxt::Quality::Normal);
+
+  // Uncompressed TGA of a page, what incremental updates start from.
+  static std::string lossless_path(const std::string& par_color_image);
 
  private:
+  struct placement {
+    std::size_t texture;  // position in textures_
+    std::uint32_t left;
+    std::uint32_t top;
+    bool rotated;
+  };
+
+  struct page {
+    std::uint32_t width;
+    std::uint32_t height;
+    std::vector<placement> placements;
+  };
+
+  // Copy of par_image with info_.margin pixels of extruded edges around it, nullptr on failure.
+  ImagePtr add_margin_(const ImagePtr& par_image, int par_orig_width, int par_orig_height) const;
+
+  // Whether the loaded atlas holds par_name.
+  bool is_loaded_(const std::string& par_name) const;
+
+  // Adds par_images, par_group are the names of all textures used together with them.
+  // par_copies are textures of the loaded atlas in that group, see copies_.
+  bool add_textures_(const std::vector<ImagePtr>& par_images,
+                     const std::vector<std::string>& par_group,
+                     const std::vector<ImagePtr>& par_copies = {});
+  bool pack_single_();
+  bool pack_pages_();
+  bool save_page_(const std::string& par_path, std::size_t par_page, dxt::Quality par_quality);
+
   std::shared_ptr<txpk::IPacker> packer_;
   txpk::TexturePtrs textures_;
+  // Per texture in textures_, whether it is a copy of a texture of the loaded atlas. A model
+  // that brings new textures gets those copies as well, so a new page holds all of its textures.
+  // The single page packer leaves them out, the loaded page has them.
+  std::vector<bool> copies_;
+
+  // Lowercase names of all added textures, including the aliases -> position in textures_.
+  // Lookups are case insensitive, like atlas_info::index.
+  std::unordered_map<std::string, std::size_t> names_;
+  // Content hash -> positions in textures_.
+  std::unordered_map<std::size_t, std::vector<std::size_t>> content_hashes_;
+  // Textures that are identical to the one at the given position in textures_.
+  std::vector<std::pair<std::string, std::size_t>> aliases_;
+  // Positions in textures_ of the textures that got added together.
+  std::vector<std::vector<std::size_t>> groups_;
 
   atlas_info info_;
-  txpk::Bin bin_;
+  std::uint32_t max_page_size_;
+  bool allow_rotation_;
+  bool lossless_;
+  std::vector<page> pages_;
   bool packed_;
+
+  // Placements and color images (one per page) of a loaded atlas.
+  std::vector<atlas_info_image> fixed_;
+  std::vector<std::string> fixed_images_;
 };
\ No newline at end of file
@@ -0,0 +1,436 @@
+#include "maxrects_packer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <tuple>
+#include <vector>
+
+#include "../parallel.h"
+
+#include "spdlog/spdlog.h"
+
+namespace {
+
+struct rect {
+  std::uint32_t x;
+  std::uint32_t y;
+  std::uint32_t width;
+  std::uint32_t height;
+
+  std::uint32_t right() const { return x + width; }
+  std::uint32_t bottom() const { return y + height; }
+
+  bool contains(const rect& par_other) const {
+    return par_other.x >= x && par_other.y >= y && par_other.right() <= right() &&
+           par_other.bottom() <= bottom();
+  }
+
+  bool intersects(const rect& par_other) const {
+    return par_other.x < right() && par_other.right() > x && par_other.y < bottom() &&
+           par_other.bottom() > y;
+  }
+};
+
+struct trial {
+  maxrects_packer::heuristic heuristic;
+  std::function<bool(const rect&, const rect&)> order;
+  std::uint32_t width;
+  bool allow_rotation;
+};
+
+struct trial_result {
+  bool ok = false;
+  std::uint32_t width = 0;
+  std::uint32_t height = 0;
+  std::vector<rect> placements;  // same order as the input, width and height swapped if rotated
+};
+
+std::uint32_t next_power_of_two(std::uint32_t par_value) {
+  std::uint32_t result = 1;
+  while (result < par_value) {
+    result <<= 1;
+  }
+  return result;
+}
+
+// Lower is better, compared lexicographically.
+std::tuple<std::uint64_t, std::uint64_t> score(maxrects_packer::heuristic par_heuristic,
+                                               const rect& par_free, std::uint32_t par_width,
+                                               std::uint32_t par_height) {
+  const std::uint64_t leftover_x = par_free.width - par_width;
+  const std::uint64_t leftover_y = par_free.height - par_height;
+  const std::uint64_t short_side = std::min(leftover_x, leftover_y);
+  const std::uint64_t long_side = std::max(leftover_x, leftover_y);
+
+  switch (par_heuristic) {
+    case maxrects_packer::heuristic::best_area_fit:
+      return {static_cast<std::uint64_t>(par_free.width) * par_free.height -
+                  static_cast<std::uint64_t>(par_width) * par_height,
+              short_side};
+    case maxrects_packer::heuristic::bottom_left:
+      return {par_free.y + par_height, par_free.x};
+    case maxrects_packer::heuristic::best_short_side_fit:
+    default:
+      return {short_side, long_side};
+  }
+}
+
+// Finds the best free rectangle for a par_width x par_height rect, turned by 90 degrees too if
+// par_allow_rotation. Returns the placement, width 0 if nothing fits.
+rect find_position(const std::vector<rect>& par_free, maxrects_packer::heuristic par_heuristic,
+                   std::uint32_t par_width, std::uint32_t par_height, bool par_allow_rotation) {
+  rect best{0, 0, 0, 0};
+  auto best_score = std::make_tuple(std::numeric_limits<std::uint64_t>::max(),
+                                    std::numeric_limits<std::uint64_t>::max());
+
+  const auto consider = [&](const rect& par_candidate, std::uint32_t par_w, std::uint32_t par_h) {
+    if (par_candidate.width < par_w || par_candidate.height < par_h) {
+      return;
+    }
+
+    const auto candidate_score = score(par_heuristic, par_candidate, par_w, par_h);
+    if (candidate_score < best_score) {
+      best_score = candidate_score;
+      best = {par_candidate.x, par_candidate.y, par_w, par_h};
+    }
+  };
+
+  for (const auto& candidate : par_free) {
+    consider(candidate, par_width, par_height);
+    if (par_allow_rotation && par_width != par_height) {
+      consider(candidate, par_height, par_width);
+    }
+  }
+
+  return best;
+}
+
+// Replaces every free rectangle overlapped by par_used with the maximal rectangles around it.
+void split_free_rects(std::vector<rect>& par_free, const rect& par_used) {
+  std::vector<rect> created;
+
+  for (std::size_t i = 0; i < par_free.size();) {
+    const rect free = par_free[i];
+    if (!free.intersects(par_used)) {
+      i++;
+      continue;
+    }
+
+    if (par_used.x > free.x) {
+      created.push_back({free.x, free.y, par_used.x - free.x, free.height});
+    }
+    if (par_used.right() < free.right()) {
+      created.push_back({par_used.right(), free.y, free.right() - par_used.right(), free.height});
+    }
+    if (par_used.y > free.y) {
+      created.push_back({free.x, free.y, free.width, par_used.y - free.y});
+    }
+    if (par_used.bottom() < free.bottom()) {
+      created.push_back(
+          {free.x, par_used.bottom(), free.width, free.bottom() - par_used.bottom()});
+    }
+
+    par_free[i] = par_free.back();
+    par_free.pop_back();
+  }
+
+  // The new rectangles are parts of maximal ones, so only they can be redundant.
+  const std::size_t kept = par_free.size();
+  for (std::size_t i = 0; i < created.size(); i++) {
+    bool redundant = std::any_of(par_free.begin(), par_free.begin() + kept,
+                                 [&](const rect& par_old) { return par_old.contains(created[i]); });
+    for (std::size_t j = 0; j < created.size() && !redundant; j++) {
+      // Of two equal rectangles keep the first.
+      redundant = j != i && created[j].contains(created[i]) &&
+                  (j < i || !created[i].contains(created[j]));
+    }
+
+    if (!redundant) {
+      par_free.push_back(created[i]);
+    }
+  }
+}
+
+trial_result run_trial(const std::vector<rect>& par_sizes, const trial& par_trial,
+                       std::uint64_t par_max_height) {
+  std::vector<std::size_t> order(par_sizes.size());
+  for (std::size_t i = 0; i < order.size(); i++) {
+    order[i] = i;
+  }
+  std::stable_sort(order.begin(), order.end(), [&](std::size_t par_a, std::size_t par_b) {
+    return par_trial.order(par_sizes[par_a], par_sizes[par_b]);
+  });
+
+  trial_result result;
+  result.width = par_trial.width;
+  result.placements.resize(par_sizes.size());
+
+  std::vector<rect> free{
+      {0, 0, par_trial.width, static_cast<std::uint32_t>(std::min<std::uint64_t>(
+                                  par_max_height, std::numeric_limits<std::uint32_t>::max()))}};
+
+  for (const std::size_t index : order) {
+    const rect& size = par_sizes[index];
+    if (size.width == 0 || size.height == 0) {
+      result.placements[index] = {0, 0, size.width, size.height};
+      continue;
+    }
+
+    const rect used = find_position(free, par_trial.heuristic, size.width, size.height,
+                                    par_trial.allow_rotation);
+    if (used.width == 0) {
+      return result;
+    }
+
+    result.placements[index] = used;
+    result.height = std::max(result.height, used.bottom());
+    split_free_rects(free, used);
+  }
+
+  result.ok = true;
+  return result;
+}
+
+}  // namespace
+
+bool maxrects_packer::validate(txpk::RectanglePtrs& par_rectangles,
+                               const txpk::uint32& par_size_constraint,
+                               const txpk::SizeContraintType& par_constraint_type,
+                               const bool& par_allow_rotation) const {
+  if (par_constraint_type == txpk::SizeContraintType::None) {
+    return true;
+  }
+
+  // Every rect has to fit the constrained side, turned if rotation is allowed.
+  const bool transpose = par_constraint_type == txpk::SizeContraintType::Height;
+  for (const auto& rectangle : par_rectangles) {
+    const std::uint32_t side = transpose ? rectangle->height : rectangle->width;
+    const std::uint32_t other = transpose ? rectangle->width : rectangle->height;
+    if (side > par_size_constraint && (!par_allow_rotation || other > par_size_constraint)) {
+      spdlog::error("maxrects_packer: a {}x{} rect doesn't fit the size constraint of {}",
+                    rectangle->width, rectangle->height, par_size_constraint);
+      return false;
+    }
+  }
+
+  return true;
+}
+
+txpk::Bin maxrects_packer::pack(txpk::RectanglePtrs& par_rectangles,
+                                const txpk::uint32& par_size_constraint,
+                                const txpk::SizeContraintType& par_constraint_type,
+                                const bool& par_allow_rotation) const {
+  txpk::Bin bin(par_rectangles);
+  bin.width = 0;
+  bin.height = 0;
+
+  if (par_rectangles.empty()) {
+    return bin;
+  }
+
+  // A height constraint is a width constraint on the transposed rectangles.
+  const bool transpose = par_constraint_type == txpk::SizeContraintType::Height;
+
+  std::vector<rect> sizes;
+  sizes.reserve(par_rectangles.size());
+  std::uint64_t area = 0;
+  std::uint64_t max_height = 0;
+  std::uint32_t min_width = 1;
+  for (const auto& rectangle : par_rectangles) {
+    const std::uint32_t width = transpose ? rectangle->height : rectangle->width;
+    const std::uint32_t height = transpose ? rectangle->width : rectangle->height;
+
+    sizes.push_back({0, 0, width, height});
+    area += static_cast<std::uint64_t>(width) * height;
+    max_height += std::max(width, height);
+    min_width = std::max(min_width, par_allow_rotation ? std::min(width, height) : width);
+  }
+
+  std::vector<std::uint32_t> widths;
+  if (par_constraint_type != txpk::SizeContraintType::None) {
+    widths.push_back(std::max(min_width, static_cast<std::uint32_t>(par_size_constraint)));
+  } else {
+    const auto square = std::max(min_width, static_cast<std::uint32_t>(std::ceil(std::sqrt(
+                                                static_cast<double>(area)))));
+    for (const double factor : {1.0, 1.1, 1.25, 1.5}) {
+      widths.push_back(static_cast<std::uint32_t>(square * factor));
+    }
+
+    const std::uint32_t pow2 = next_power_of_two(square);
+    for (const std::uint32_t width : {pow2 / 2, pow2, pow2 * 2}) {
+      if (width >= min_width) {
+        widths.push_back(width);
+      }
+    }
+
+    std::sort(widths.begin(), widths.end());
+    widths.erase(std::unique(widths.begin(), widths.end()), widths.end());
+  }
+
+  const std::vector<std::function<bool(const rect&, const rect&)>> orders = {
+      [](const rect& par_a, const rect& par_b) {
+        return static_cast<std::uint64_t>(par_a.width) * par_a.height >
+               static_cast<std::uint64_t>(par_b.width) * par_b.height;
+      },
+      [](const rect& par_a, const rect& par_b) {
+        return std::max(par_a.width, par_a.height) > std::max(par_b.width, par_b.height);
+      },
+      [](const rect& par_a, const rect& par_b) { return par_a.height > par_b.height; },
+      [](const rect& par_a, const rect& par_b) { return par_a.width > par_b.width; },
+      [](const rect& par_a, const rect& par_b) {
+        return par_a.width + par_a.height > par_b.width + par_b.height;
+      },
+  };
+
+  std::vector<trial> trials;
+  for (const auto heuristic :
+       {heuristic::best_short_side_fit, heuristic::best_area_fit, heuristic::bottom_left}) {
+    for (const auto& order : orders) {
+      for (const auto width : widths) {
+        trials.push_back({heuristic, order, width, par_allow_rotation});
+      }
+    }
+  }
+
+  std::vector<trial_result> results(trials.size());
+  ups::parallel_for(trials.size(), [&](std::size_t par_i) {
+    results[par_i] = run_trial(sizes, trials[par_i], max_height);
+  });
+
+  const auto bin_size = [this](const trial_result& par_result) {
+    // Trim to the used width, the candidate width may not be filled.
+    std::uint32_t width = 0;
+    for (const auto& placement : par_result.placements) {
+      width = std::max(width, placement.right());
+    }
+
+    std::uint32_t height = par_result.height;
+    if (power_of_two_) {
+      width = next_power_of_two(width);
+      height = next_power_of_two(height);
+    }
+    return std::make_pair(width, height);
+  };
+
+  const trial_result* best = nullptr;
+  std::tuple<std::uint64_t, std::uint32_t> best_score;
+  for (const auto& result : results) {
+    if (!result.ok) {
+      continue;
+    }
+
+    const auto [width, height] = bin_size(result);
+    const std::tuple<std::uint64_t, std::uint32_t> result_score{
+        static_cast<std::uint64_t>(width) * height, std::max(width, height)};
+    if (best == nullptr || result_score < best_score) {
+      best = &result;
+      best_score = result_score;
+    }
+  }
+
+  if (best == nullptr) {
+    spdlog::error("maxrects_packer: no trial could place all rectangles");
+    return bin;
+  }
+
+  const auto [width, height] = bin_size(*best);
+  bin.width = transpose ? height : width;
+  bin.height = transpose ? width : height;
+
+  for (std::size_t i = 0; i < par_rectangles.size(); i++) {
+    par_rectangles[i]->left = transpose ? best->placements[i].y : best->placements[i].x;
+    par_rectangles[i]->top = transpose ? best->placements[i].x : best->placements[i].y;
+    if (best->placements[i].width != sizes[i].width) {
+      par_rectangles[i]->rotate();
+    }
+  }
+
+  return bin;
+}
+
+bool maxrects_packer::pack_around(const txpk::RectanglePtrs& par_fixed,
+                                  txpk::RectanglePtrs& par_rectangles, txpk::uint32& par_width,
+                                  txpk::uint32& par_height, bool par_allow_rotation,
+                                  txpk::uint32 par_max_size) const {
+  std::vector<std::size_t> order(par_rectangles.size());
+  for (std::size_t i = 0; i < order.size(); i++) {
+    order[i] = i;
+  }
+  std::stable_sort(order.begin(), order.end(), [&](std::size_t par_a, std::size_t par_b) {
+    return par_rectangles[par_a]->getArea() > par_rectangles[par_b]->getArea();
+  });
+
+  std::uint32_t width = std::max<std::uint32_t>(par_width, 1);
+  std::uint32_t height = std::max<std::uint32_t>(par_height, 1);
+  if (power_of_two_) {
+    width = next_power_of_two(width);
+    height = next_power_of_two(height);
+  }
+  if (par_max_size != 0) {
+    width = std::min(width, std::max(par_max_size, par_width));
+    height = std::min(height, std::max(par_max_size, par_height));
+  }
+
+  for (;;) {
+    std::vector<rect> free{{0, 0, width, height}};
+    for (const auto& fixed : par_fixed) {
+      split_free_rects(free, {fixed->left, fixed->top, fixed->width, fixed->height});
+    }
+
+    std::vector<rect> placements(par_rectangles.size());
+    bool fits = true;
+    for (const std::size_t index : order) {
+      const auto& rectangle = par_rectangles[index];
+      if (rectangle->width == 0 || rectangle->height == 0) {
+        placements[index] = {0, 0, rectangle->width, rectangle->height};
+        continue;
+      }
+
+      placements[index] = find_position(free, heuristic::best_short_side_fit, rectangle->width,
+                                        rectangle->height, par_allow_rotation);
+      if (placements[index].width == 0) {
+        fits = false;
+        break;
+      }
+
+      split_free_rects(free, placements[index]);
+    }
+
+    if (fits) {
+      for (std::size_t i = 0; i < par_rectangles.size(); i++) {
+        par_rectangles[i]->left = placements[i].x;
+        par_rectangles[i]->top = placements[i].y;
+        if (placements[i].width != par_rectangles[i]->width) {
+          par_rectangles[i]->rotate();
+        }
+      }
+
+      par_width = width;
+      par_height = height;
+      return true;
+    }
+
+    if (width > (1U << 30) || height > (1U << 30)) {
+      spdlog::error("maxrects_packer: the bin outgrew every sane size");
+      return false;
+    }
+
+    bool grow_width = width <= height;
+    if (par_max_size != 0) {
+      if (width >= par_max_size && height >= par_max_size) {
+        return false;
+      }
+      if (width >= par_max_size || height >= par_max_size) {
+        grow_width = width < par_max_size;
+      }
+    }
+
+    if (grow_width) {
+      width = par_max_size != 0 ? std::min(width * 2, par_max_size) : width * 2;
+    } else {
+      height = par_max_size != 0 ? std::min(height * 2, par_max_size) : height * 2;
+    }
+  }
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <TXPK/Core/IPacker.hpp>
+
+/**
+ * MaxRects packer, see Jukka Jylänki - "A Thousand Ways to Pack the Bin".
+ *
+ * Every heuristic is tried with several sort orders and bin widths, the trials run in parallel
+ * and the bin with the smallest area (after rounding to power of two if requested) wins.
+ * With par_allow_rotation rects may get turned by 90 degrees, Rectangle::isRotated() tells.
+ */
+class maxrects_packer : public txpk::IPacker {
+ public:
+  enum class heuristic {
+    best_short_side_fit,  // smallest leftover on the shorter side
+    best_area_fit,        // smallest free rectangle
+    bottom_left           // lowest position, then leftmost (Tetris)
+  };
+
+  explicit maxrects_packer(bool par_power_of_two = false) : power_of_two_(par_power_of_two) {}
+
+  bool validate(txpk::RectanglePtrs& par_rectangles, const txpk::uint32& par_size_constraint = 0,
+                const txpk::SizeContraintType& par_constraint_type =
+                    txpk::SizeContraintType::None,
+                const bool& par_allow_rotation = false) const override;
+
+  txpk::Bin pack(txpk::RectanglePtrs& par_rectangles, const txpk::uint32& par_size_constraint = 0,
+                 const txpk::SizeContraintType& par_constraint_type =
+                     txpk::SizeContraintType::None,
+                 const bool& par_allow_rotation = false) const override;
+
+  /**
+   * Places par_rectangles into the space par_fixed leaves free in a par_width x par_height bin,
+   * the fixed rectangles don't move. The bin grows to the right/bottom (shorter side first)
+   * until everything fits, par_width and par_height get updated. With par_max_size it doesn't
+   * grow beyond par_max_size x par_max_size, false if they don't fit then.
+   */
+  bool pack_around(const txpk::RectanglePtrs& par_fixed, txpk::RectanglePtrs& par_rectangles,
+                   txpk::uint32& par_width, txpk::uint32& par_height,
+                   bool par_allow_rotation = false, txpk::uint32 par_max_size = 0) const;
+
+ private:
+  bool power_of_two_;
+};
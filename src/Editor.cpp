@@ -29,6 +29,7 @@
 #include "Texture.h"
 #include "CfgParser.h"
 #include "config.h"
+#include "model_scan.h"
 
 #include "AnimationUI.h"
 #include "FileSearch.h"
@@ -204,10 +205,7 @@ void EditorUI::Initialize() {
   UpdateTitle();
 
   textureHandler = std::make_shared<TextureHandler>();
-
-  for (auto arch = archives.archives.begin(); arch != archives.archives.end(); ++arch) {
-    textureHandler->Load3DO(arch->c_str());
-  }
+  MountArchives();
 
   textureGroupHandler = new TextureGroupHandler(textureHandler);
   textureGroupHandler->Load((ups::config::get().app_path() / TextureGroupConfig).string());
@@ -712,7 +710,6 @@ void EditorUI::BrowseForTexture(int textureIndex) {
   if (FileOpenDlg("Select texture:", ImageFileExt, filename)) {
     auto tex = std::make_shared<Texture>(filename);
     if (!tex->HasError()) {
-      tex->image->flip();
       SetModelTexture(textureIndex, tex);
       Update();
     }
@@ -736,14 +733,10 @@ void EditorUI::ReloadTexture(int index) {
 }
 
 void EditorUI::ConvertToS3O() {
-  static int texW = 256;
-  static int texH = 256;
-
-  texW = atoi(fltk::input("Enter texture width: ", SPrintf("%d", texW).c_str()));
-  texH = atoi(fltk::input("Enter texture height: ", SPrintf("%d", texH).c_str()));
+  // The texture grows until everything fits.
   std::string const name_ext = fltk::filename_name(filename.c_str());
   std::string const name(name_ext.c_str(), fltk::filename_ext(name_ext.c_str()));
-  if (model->ConvertToS3O(GetFilePath(filename) + "/" + name + "_tex1.dds", texW, texH)) {
+  if (model->ConvertToS3O(GetFilePath(filename) + "/" + name + "_tex1.dds")) {
     // Update the UI
     SetModelTexture(0, model->texBindings[0].texture);
     SetMapping(MAPPING_S3O);
@@ -1023,10 +1016,22 @@ void EditorUI::menuSettingsShowArchiveList() {
     archives = sui.settings;
     archives.Save();
 
-    for (auto arch = archives.archives.begin(); arch != archives.archives.end(); ++arch) {
-      textureHandler->Load3DO(arch->c_str());
+    MountArchives();
+  }
+}
+
+void EditorUI::MountArchives() {
+  vfs = std::make_shared<CVirtualFileSystem>();
+
+  // Mounted last to first, so the first listed archive wins like it did before there was a VFS.
+  // Only the textures are needed, directory archives (dev checkouts) don't get walked as a whole.
+  for (auto arch = archives.archives.rbegin(); arch != archives.archives.rend(); ++arch) {
+    if (!vfs->Mount(*arch, {"unittextures/"})) {
+      spdlog::warn("Failed to mount the archive '{}'", *arch);
     }
   }
+
+  textureHandler->Load3DO(*vfs);
 }
 
 // Show texture group window
@@ -1335,7 +1340,30 @@ int main(int argc, char* argv[]) {
         run_script(app, par_script_file);
       },
       "Run a lua script file and exit");
-  app.callback([&app, &argv]() {
+
+  std::string scan_archive;
+  std::string scan_prefix = "objects3d/";
+  std::string scan_format = "csv";
+  std::string scan_output;
+  std::size_t scan_slowest = 10;
+  app.add_option("--scan-models", scan_archive,
+                 "Load every model in an archive or directory, print statistics and exit");
+  app.add_option("--scan-prefix", scan_prefix, "Only scan models below this path")
+      ->capture_default_str();
+  app.add_option("--scan-format", scan_format, "Statistics format")
+      ->check(CLI::IsMember({"csv", "json"}))
+      ->capture_default_str();
+  app.add_option("--scan-output", scan_output, "Write the statistics to a file, not stdout");
+  app.add_option("--scan-slowest", scan_slowest, "How many of the slowest models to report")
+      ->capture_default_str();
+
+  app.callback([&]() {
+    if (!scan_archive.empty()) {
+      ups::config::get().app_path(std::filesystem::path(argv[0]).remove_filename());
+      std::exit(
+          ups::run_model_scan(scan_archive, scan_prefix, scan_format, scan_output, scan_slowest));
+    }
+
     CLI::App subApp;
     std::string model_file;
     subApp.add_option("file", model_file, "Model file to load");
@@ -94,6 +94,7 @@ void InitTexBrowser() const;
 TextureGroup* GetCurrentTexGroup() const;
 fltk::Color SetTeamColor();
 void LoadSettings();
+void MountArchives();
 void LoadToolWindowSettings() const;
 void SerializeConfig(CfgList& cfg, bool store);
 
@@ -132,6 +133,8 @@ EditorCB callback;
 CopyBuffer copyBuffer;
 ArchiveList archives;
 
+// Directory archives only have unittextures/ indexed, see MountArchives().
+std::shared_ptr<CVirtualFileSystem> vfs;
 std::shared_ptr<TextureHandler> textureHandler;
 TextureGroupHandler* textureGroupHandler{};
 
@@ -8,66 +8,102 @@
 #include "Model.h"
 #include "Util.h"
 #include "config.h"
+#include "TAPalette.h"
 
 #include "spdlog/spdlog.h"
 
-class CTAPalette {
- public:
-  CTAPalette() = default;
-
-  void Init() {
-    std::string const fn = (ups::config::get().app_path() / "data" / "palette.pal").string();
-    FILE* f = fopen(fn.c_str(), "rb");
-    if (f == nullptr) {
-      if (!error) {
-        spdlog::error("Failed to load data/palette.pal");
-      }
-      error = true;
-    } else {
-      for (auto& c : p) {
-        for (unsigned char& c2 : c) {
-          c2 = fgetc(f);
-        }
-        c[3] = 255;
+void CTAPalette::Init() {
+  std::string const fn = (ups::config::get().app_path() / "data" / "palette.pal").string();
+  FILE* f = fopen(fn.c_str(), "rb");
+  if (f == nullptr) {
+    if (!error) {
+      spdlog::error("Failed to load data/palette.pal");
+    }
+    error = true;
+  } else {
+    for (auto& c : p) {
+      for (unsigned char& c2 : c) {
+        c2 = fgetc(f);
       }
-      fclose(f);
+      c[3] = 255;
     }
+    fclose(f);
+    loaded = true;
   }
+}
 
-  int FindIndex(Vector3 color) {
-    if (!loaded) {
-      Init();
-    }
-    int const r = color.x * 255;
-    int const g = color.y * 255;
-    int const b = color.z * 255;
-    int best = -1;
-    int bestdif = 0;
-    for (int a = 0; a < 256; a++) {
-      int const dif = abs(r - p[a][0]) + abs(g - p[a][1]) + abs(b - p[a][2]);
-      if (best < 0 || bestdif > dif) {
-        bestdif = dif;
-        best = a;
-      }
+int CTAPalette::FindIndex(Vector3 color) {
+  if (!loaded) {
+    Init();
+  }
+  int const r = color.x * 255;
+  int const g = color.y * 255;
+  int const b = color.z * 255;
+  int best = -1;
+  int bestdif = 0;
+  for (int a = 0; a < 256; a++) {
+    int const dif = abs(r - p[a][0]) + abs(g - p[a][1]) + abs(b - p[a][2]);
+    if (best < 0 || bestdif > dif) {
+      bestdif = dif;
+      best = a;
     }
-    return best;
   }
+  return best;
+}
+
+Vector3 CTAPalette::GetColor(int index) {
+  if (!loaded) {
+    Init();
+  }
+  if (index < 0 || index >= 256) {
+    return Vector3();
+  }
+  // Integer division, every channel is 0 or 1. Polygon colors (and the color_%d atlas names
+  // derived from them) have always been quantised like this, the palette image holds the real
+  // colors.
+  return Vector3(p[index][0] / 255, p[index][1] / 255, p[index][2] / 255);
+}
 
-  Vector3 GetColor(int index) {
-    if (!loaded) {
-      Init();
-    }
-    if (index < 0 || index >= 256) {
-      return Vector3();
+int CTAPalette::BlockSize(int margin) {
+  int size = kMinBlockSize;
+  while (size < 2 * margin + 1) {
+    size *= 2;
+  }
+  return size;
+}
+
+std::shared_ptr<Image> CTAPalette::CreateImage(int blockSize) {
+  if (!loaded) {
+    Init();
+  }
+
+  blockSize = std::max(blockSize, 1);
+  const int size = kEntriesPerRow * blockSize;
+
+  auto image = std::make_shared<Image>();
+  image->name("ta_palette");
+  if (!image->create(size, size, 3)) {
+    spdlog::error("Failed to create the palette image, error was: {}", image->error());
+    return image;
+  }
+
+  std::uint8_t* data = image->data();
+  for (int y = 0; y < size; y++) {
+    std::uint8_t* row = data + static_cast<std::size_t>(y) * size * 3;
+    for (int x = 0; x < size; x++) {
+      const unsigned char* color = p[(y / blockSize) * kEntriesPerRow + x / blockSize];
+      row[x * 3 + 0] = color[0];
+      row[x * 3 + 1] = color[1];
+      row[x * 3 + 2] = color[2];
     }
-    return Vector3(p[index][0] / 255, p[index][1] / 255, p[index][2] / 255);
   }
 
-  inline unsigned char* operator[](int a) { return p[a]; }
-  unsigned char p[256][4]{};
-  bool loaded{false}, error{false};
-};
-CTAPalette palette;
+  return image;
+}
+
+static CTAPalette palette;
+
+CTAPalette& GetTAPalette() { return palette; }
 
 const float scaleFactor = 1 / (65536.0F);
 
@@ -214,18 +250,24 @@ bool Model::Load3DO(const char* filename, IProgressCtl& /*progctl*/) {
     return false;
   }
 
-  root = load_object(0, f, nullptr);
-  if (root == nullptr) {
-    fclose(f);
+  const bool result = Load3DO(f);
+  fclose(f);
+  if (!result) {
     return false;
   }
 
-  mapping = MAPPING_3DO;
+  file_ = filename;
 
-  fclose(f);
+  return true;
+}
 
-  file_ = filename;
+bool Model::Load3DO(FILE* f) {
+  root = load_object(0, f, nullptr);
+  if (root == nullptr) {
+    return false;
+  }
 
+  mapping = MAPPING_3DO;
   return true;
 }
 
@@ -157,26 +157,36 @@ static MdlObject* S3O_LoadObject(FILE* f, int offset) {
 }
 
 bool Model::LoadS3O(const char* filename, IProgressCtl& /*progctl*/) {
-  S3OHeader header{};
-  size_t const read_result = 0;
   FILE* fp = fopen(filename, "rb");
   if (fp == nullptr) {
     return false;
   }
 
+  const bool result = LoadS3O(fp, filename, true);
+  fclose(fp);
+  if (!result) {
+    return false;
+  }
+
+  file_ = filename;
+
+  return true;
+}
+
+bool Model::LoadS3O(FILE* fp, const char* filename, bool load_textures) {
+  S3OHeader header{};
+
   if (fread(&header, sizeof(S3OHeader), 1, fp) != 0U) {
   }
 
   if (memcmp(header.magic, S3O_ID, 12) != 0) {
     spdlog::error("S3O model '{}' has a wrong identification", filename);
-    fclose(fp);
     return false;
   }
 
   if (header.version != 0) {
     spdlog::error("S3O model '{}' has a wrong version ({}, wanted: {})", filename, header.version,
                   0);
-    fclose(fp);
     return false;
   }
 
@@ -199,21 +209,19 @@ bool Model::LoadS3O(const char* filename, IProgressCtl& /*progctl*/) {
     TextureBinding& tb = texBindings.back();
 
     tb.name = Readstring(tex == 1 ? header.texture2 : header.texture1, fp);
+    if (!load_textures) {
+      continue;
+    }
+
     tb.texture = std::make_shared<Texture>();
     if (!tb.texture->Load(tb.name, mdlPath) or tb.texture->HasError()) {
       tb.texture = nullptr;
       continue;
     }
-
-    tb.texture->image->flip();
   }
 
   mapping = MAPPING_S3O;
 
-  fclose(fp);
-
-  file_ = filename;
-
   return true;
 }
 
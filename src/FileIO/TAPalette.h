@@ -0,0 +1,52 @@
+//-----------------------------------------------------------------------
+//  Upspring model editor
+//  Copyright 2005 Jelmer Cnossen
+//  This code is released under GPL license, see LICENSE.HTML for info.
+//-----------------------------------------------------------------------
+#ifndef TAPaletteH
+#define TAPaletteH
+
+#include <memory>
+
+#include "../math/Mathlib.h"
+
+class Image;
+
+/// The 256 colour palette 3DO polygon colours index into, loaded from data/palette.pal
+class CTAPalette {
+ public:
+  /// Palette entries per row and column of the palette image
+  static constexpr int kEntriesPerRow = 16;
+  /// Smallest block of texels per entry, keeps the first mip levels free of bleeding
+  static constexpr int kMinBlockSize = 8;
+
+  CTAPalette() = default;
+
+  void Init();
+
+  int FindIndex(Vector3 color);
+  Vector3 GetColor(int index);
+
+  /// Column and row of a palette entry's block in the image from CreateImage()
+  static int ImageX(int index) { return index % kEntriesPerRow; }
+  static int ImageY(int index) { return index / kEntriesPerRow; }
+
+  /// Block size for an atlas margin, a power of two of at least 2 * margin + 1 texels
+  static int BlockSize(int margin);
+
+  /**
+   * All palette colours in an RGB image of kEntriesPerRow x kEntriesPerRow blocks, entry i in
+   * block row i / kEntriesPerRow. Every block is blockSize texels wide and filled with its colour,
+   * so sampling the centre of a block doesn't pick up its neighbours under bilinear filtering
+   * and mipmaps.
+   */
+  std::shared_ptr<Image> CreateImage(int blockSize = kMinBlockSize);
+
+  inline unsigned char* operator[](int a) { return p[a]; }
+  unsigned char p[256][4]{};
+  bool loaded{false}, error{false};
+};
+
+CTAPalette& GetTAPalette();
+
+#endif
@@ -0,0 +1,208 @@
+#include "CArchiveIndexCache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <string_view>
+
+#include "CMappedFile.h"
+#include "../config.h"
+
+#include "spdlog/spdlog.h"
+
+namespace {
+
+constexpr char kCacheMagic[4] = {'U', 'P', 'A', 'C'};
+constexpr std::uint32_t kCacheVersion = 1;
+
+// All offsets are relative to the start of the name block, which follows the entries.
+struct cache_header {
+  char magic[4];
+  std::uint32_t version;
+  std::uint32_t type;
+  std::uint32_t count;
+  std::uint64_t archive_size;
+  std::int64_t archive_mtime;
+  std::uint32_t path_offset;
+  std::uint32_t path_length;
+  std::uint32_t names_size;
+  std::uint32_t reserved;
+};
+
+struct cache_entry {
+  std::uint64_t id;
+  std::uint64_t size;
+  std::uint32_t crc;
+  std::uint32_t mode;
+  std::uint32_t name_offset;
+  std::uint32_t name_length;
+  std::uint32_t lower_offset;
+  std::uint32_t lower_length;
+};
+
+struct archive_key {
+  std::string path;
+  std::uint64_t size;
+  std::int64_t mtime;
+};
+
+bool make_key(const std::string& par_archive_path, archive_key& par_key) {
+  std::error_code ec;
+  const auto path = std::filesystem::absolute(par_archive_path, ec);
+  if (ec) {
+    return false;
+  }
+
+  par_key.path = path.string();
+  par_key.size = std::filesystem::file_size(path, ec);
+  if (ec) {
+    return false;
+  }
+  par_key.mtime = std::filesystem::last_write_time(path, ec).time_since_epoch().count();
+  return !ec;
+}
+
+}  // namespace
+
+std::filesystem::path CArchiveIndexCache::CacheFile(const std::string& absPath, Type type) {
+  const std::size_t hash = std::hash<std::string_view>{}(absPath);
+  char name[48];
+  snprintf(name, sizeof(name), "%016llx_%u.idx", static_cast<unsigned long long>(hash),
+           static_cast<unsigned>(type));
+  return ups::config::get().cache_path() / "archives" / name;
+}
+
+bool CArchiveIndexCache::Load(const std::string& archivePath, Type type,
+                              std::vector<Entry>& entries) {
+  archive_key key;
+  if (!make_key(archivePath, key)) {
+    return false;
+  }
+
+  const auto cacheFile = CacheFile(key.path, type);
+  const CMappedFile file(cacheFile.string());
+  if (!file.IsOpen()) {
+    return false;
+  }
+  const auto buf = file.Data();
+
+  cache_header header;
+  if (buf.size() < sizeof(header)) {
+    return false;
+  }
+  std::memcpy(&header, buf.data(), sizeof(header));
+
+  const std::size_t namesStart = sizeof(header) + header.count * sizeof(cache_entry);
+  if (std::memcmp(header.magic, kCacheMagic, sizeof(kCacheMagic)) != 0 ||
+      header.version != kCacheVersion || header.type != static_cast<std::uint32_t>(type) ||
+      buf.size() != namesStart + header.names_size) {
+    spdlog::debug("Ignoring invalid archive index cache '{}'", cacheFile.string());
+    return false;
+  }
+
+  const char* names = reinterpret_cast<const char*>(buf.data() + namesStart);
+  const auto nameAt = [&](std::uint32_t offset, std::uint32_t length, std::string& out) {
+    if (static_cast<std::uint64_t>(offset) + length > header.names_size) {
+      return false;
+    }
+    out.assign(names + offset, length);
+    return true;
+  };
+
+  // Another archive with the same hash, or the archive changed.
+  std::string path;
+  if (!nameAt(header.path_offset, header.path_length, path) || path != key.path ||
+      header.archive_size != key.size || header.archive_mtime != key.mtime) {
+    return false;
+  }
+
+  entries.clear();
+  entries.resize(header.count);
+  for (std::uint32_t i = 0; i < header.count; i++) {
+    cache_entry entry;
+    std::memcpy(&entry, buf.data() + sizeof(header) + i * sizeof(entry), sizeof(entry));
+
+    auto& result = entries[i];
+    result.id = entry.id;
+    result.size = entry.size;
+    result.crc = entry.crc;
+    result.mode = entry.mode;
+    if (!nameAt(entry.name_offset, entry.name_length, result.name) ||
+        !nameAt(entry.lower_offset, entry.lower_length, result.lowerName)) {
+      spdlog::debug("Ignoring invalid archive index cache '{}'", cacheFile.string());
+      entries.clear();
+      return false;
+    }
+  }
+
+  spdlog::debug("Using the index cache for '{}', {} files", key.path, entries.size());
+  return true;
+}
+
+bool CArchiveIndexCache::Save(const std::string& archivePath, Type type,
+                              const std::vector<Entry>& entries) {
+  archive_key key;
+  if (!make_key(archivePath, key)) {
+    return false;
+  }
+
+  std::string names;
+  const auto addName = [&names](const std::string& name) {
+    const auto offset = static_cast<std::uint32_t>(names.size());
+    names += name;
+    return offset;
+  };
+
+  cache_header header{};
+  std::memcpy(header.magic, kCacheMagic, sizeof(kCacheMagic));
+  header.version = kCacheVersion;
+  header.type = static_cast<std::uint32_t>(type);
+  header.count = static_cast<std::uint32_t>(entries.size());
+  header.archive_size = key.size;
+  header.archive_mtime = key.mtime;
+  header.path_offset = addName(key.path);
+  header.path_length = static_cast<std::uint32_t>(key.path.size());
+
+  std::vector<cache_entry> records;
+  records.reserve(entries.size());
+  for (const auto& entry : entries) {
+    const std::uint32_t nameOffset = addName(entry.name);
+    // Most names are lower-case already, share them.
+    const std::uint32_t lowerOffset =
+        entry.lowerName == entry.name ? nameOffset : addName(entry.lowerName);
+    records.push_back({entry.id, entry.size, entry.crc, entry.mode, nameOffset,
+                       static_cast<std::uint32_t>(entry.name.size()), lowerOffset,
+                       static_cast<std::uint32_t>(entry.lowerName.size())});
+  }
+  header.names_size = static_cast<std::uint32_t>(names.size());
+
+  const auto cacheFile = CacheFile(key.path, type);
+  std::error_code ec;
+  std::filesystem::create_directories(cacheFile.parent_path(), ec);
+
+  // Written next to it and renamed, so a concurrent Load() never sees half a file.
+  auto tmpFile = cacheFile;
+  tmpFile += ".tmp";
+  FILE* fp = fopen(tmpFile.string().c_str(), "wb");
+  if (fp == nullptr) {
+    spdlog::debug("Can't write the archive index cache '{}'", tmpFile.string());
+    return false;
+  }
+
+  bool result = fwrite(&header, sizeof(header), 1, fp) == 1;
+  if (result && !records.empty()) {
+    result = fwrite(records.data(), sizeof(cache_entry), records.size(), fp) == records.size();
+  }
+  if (result && !names.empty()) {
+    result = fwrite(names.data(), names.size(), 1, fp) == 1;
+  }
+  result = fclose(fp) == 0 && result;
+
+  if (result) {
+    std::filesystem::rename(tmpFile, cacheFile, ec);
+    result = !ec;
+  }
+  if (!result) {
+    std::filesystem::remove(tmpFile, ec);
+  }
+  return result;
+}
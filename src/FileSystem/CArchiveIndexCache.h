@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+/**
+ * On-disk cache of the file table of an archive, so opening a large
+ * archive again doesn't have to walk all of its headers.
+ *
+ * Cache files live in ups::config::cache_path() and are keyed by the
+ * absolute archive path, its size and its modification time; a changed
+ * archive simply misses the cache.
+ */
+class CArchiveIndexCache {
+ public:
+  enum class Type : std::uint32_t {
+    SevenZip = 1,
+    Zip = 2,
+  };
+
+  struct Entry {
+    std::uint64_t id;  // 7z file index, zip central directory position
+    std::uint64_t size;
+    std::uint32_t crc;
+    std::uint32_t mode;
+    std::string name;  // as the archive has it
+    std::string lowerName;
+  };
+
+  /**
+   * Memory-maps the cache file of archivePath.
+   * @return false if there is no valid cache for the archive as it is now
+   */
+  static bool Load(const std::string& archivePath, Type type, std::vector<Entry>& entries);
+  /**
+   * @return false if the cache file couldn't be written, which is harmless
+   */
+  static bool Save(const std::string& archivePath, Type type, const std::vector<Entry>& entries);
+
+ private:
+  static std::filesystem::path CacheFile(const std::string& absPath, Type type);
+};
@@ -4,32 +4,68 @@
 #include <fstream>
 #include <filesystem>
 
+#include "CMappedFile.h"
 #include "../string_util.h"
 
 #include "spdlog/spdlog.h"
 
-CDirectoryArchive::CDirectoryArchive(const std::string& name) : IArchive(name) {
+CDirectoryArchive::CDirectoryArchive(const std::string& name,
+                                     const std::vector<std::string>& par_prefixes)
+    : IArchive(name) {
   auto tmp = std::filesystem::absolute(name).string();
   if ('/' == tmp.back()) {
     tmp.pop_back();
   }
   dirname_ = tmp;
-  auto dirnameLen = tmp.length();
 
   spdlog::debug("Scanning {}", tmp);
 
-  for (const auto& dirEntry : std::filesystem::recursive_directory_iterator(dirname_)) {
-    auto filename = dirEntry.path().string().substr(dirnameLen + 1);
+  // A path is wanted when it's below a prefix, directories also when a prefix is below them.
+  const auto wanted = [&par_prefixes](const std::string& par_path, bool par_is_dir) {
+    if (par_prefixes.empty()) {
+      return true;
+    }
+    return std::any_of(par_prefixes.begin(), par_prefixes.end(), [&](const std::string& par_p) {
+      if (par_path.rfind(par_p, 0) == 0) {
+        return true;
+      }
+      return par_is_dir && par_p.rfind(par_path + '/', 0) == 0;
+    });
+  };
+
+  std::error_code ec;
+  auto it = std::filesystem::recursive_directory_iterator(
+      dirname_, std::filesystem::directory_options::skip_permission_denied, ec);
+  for (; !ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec)) {
+    const auto& dirEntry = *it;
+    // With '/' on every platform, like the names in the other archives and the prefixes.
+    auto filename = dirEntry.path().lexically_relative(dirname_).generic_string();
     auto lc_file_name = to_lower(filename);
 
-    std::size_t size = 0;
-    if (dirEntry.is_regular_file()) {
-      size = dirEntry.file_size();
+    if (dirEntry.is_directory(ec)) {
+      if (!wanted(lc_file_name, true)) {
+        it.disable_recursion_pending();
+      }
+      continue;
+    }
+
+    if (!dirEntry.is_regular_file(ec) || !wanted(lc_file_name, false)) {
+      continue;
+    }
+
+    const std::size_t size = dirEntry.file_size(ec);
+    if (ec) {
+      ec.clear();
+      continue;
     }
 
     lcNameIndex[lc_file_name] = fileEntries_.size();
     fileEntries_.emplace_back(size, lc_file_name, filename, 0777);
   }
+
+  if (ec) {
+    spdlog::error("Failed to scan '{}', error was: {}", tmp, ec.message());
+  }
 }
 
 CDirectoryArchive::~CDirectoryArchive() {}
@@ -44,9 +80,27 @@ bool CDirectoryArchive::GetFile(std::size_t par_fid, std::vector<std::uint8_t>&
     return false;
   }
 
-  std::for_each(std::istreambuf_iterator<char>(instream), std::istreambuf_iterator<char>(),
-                [&par_buffer](const char c) { par_buffer.push_back(c); });
+  par_buffer.resize(fileEntries_[par_fid].size);
+  instream.read(reinterpret_cast<char*>(par_buffer.data()),
+                static_cast<std::streamsize>(par_buffer.size()));
+
+  // The file may have shrunk since it got indexed.
+  par_buffer.resize(static_cast<std::size_t>(instream.gcount()));
+  return true;
+}
+
+bool CDirectoryArchive::GetMappedView(std::size_t par_fid, FileView& par_view) {
+  if (fileEntries_[par_fid].size < kMinMappedSize) {
+    return false;
+  }
+
+  auto file = std::make_shared<CMappedFile>((dirname_ / fileEntries_[par_fid].orig_name).string());
+  if (!file->IsOpen()) {
+    return false;
+  }
 
+  const std::size_t size = file->Size();
+  par_view.Assign(std::move(file), 0, size);
   return true;
 }
 
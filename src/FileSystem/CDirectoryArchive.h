@@ -13,13 +13,26 @@
  */
 class CDirectoryArchive : public IArchive {
  public:
-  explicit CDirectoryArchive(const std::string& name);
+  /**
+   * @param name directory to index, recursively
+   * @param prefixes when not empty only files below these lower-case
+   *   paths get indexed, for example "unittextures/"
+   */
+  explicit CDirectoryArchive(const std::string& name,
+                             const std::vector<std::string>& prefixes = {});
   virtual ~CDirectoryArchive();
 
   virtual std::size_t NumFiles() const override;
   virtual void FileInfo(std::size_t fid, std::string& name, int& size, int& mode) const override;
 
   virtual bool GetFile(std::size_t fid, std::vector<std::uint8_t>& buffer) override;
+  /**
+   * Maps files of at least kMinMappedSize bytes, smaller ones are cheaper
+   * to read.
+   */
+  virtual bool GetMappedView(std::size_t fid, FileView& view) override;
+
+  static constexpr std::size_t kMinMappedSize = 64 * 1024;
 
  private:
   struct FileData {
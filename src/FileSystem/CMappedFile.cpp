@@ -0,0 +1,109 @@
+#include "CMappedFile.h"
+
+#include <utility>
+
+#ifdef _WIN32
+#include <windows.h>
+#include "../string_util.h"
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "spdlog/spdlog.h"
+
+CMappedFile::CMappedFile(const std::string& path) {
+#ifdef _WIN32
+  HANDLE file = CreateFileW(s2ws(path).c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    return;
+  }
+
+  LARGE_INTEGER fileSize;
+  if (GetFileSizeEx(file, &fileSize) == 0) {
+    CloseHandle(file);
+    return;
+  }
+
+  size = static_cast<std::size_t>(fileSize.QuadPart);
+  if (size > 0) {
+    // The mapping keeps the file open by itself.
+    mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping != nullptr) {
+      data = static_cast<const std::uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    }
+  }
+  CloseHandle(file);
+
+  if (size > 0 && data == nullptr) {
+    spdlog::debug("Failed to map '{}'", path);
+    Close();
+    return;
+  }
+#else
+  const int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return;
+  }
+
+  struct stat st {};
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return;
+  }
+
+  size = static_cast<std::size_t>(st.st_size);
+  if (size > 0) {
+    void* addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (addr == MAP_FAILED) {
+      spdlog::debug("Failed to map '{}'", path);
+      close(fd);
+      size = 0;
+      return;
+    }
+    data = static_cast<const std::uint8_t*>(addr);
+  }
+  close(fd);
+#endif
+
+  isOpen = true;
+}
+
+CMappedFile::~CMappedFile() { Close(); }
+
+CMappedFile::CMappedFile(CMappedFile&& other) noexcept { *this = std::move(other); }
+
+CMappedFile& CMappedFile::operator=(CMappedFile&& other) noexcept {
+  if (this != &other) {
+    Close();
+    data = std::exchange(other.data, nullptr);
+    size = std::exchange(other.size, 0);
+    isOpen = std::exchange(other.isOpen, false);
+#ifdef _WIN32
+    mapping = std::exchange(other.mapping, nullptr);
+#endif
+  }
+  return *this;
+}
+
+void CMappedFile::Close() {
+#ifdef _WIN32
+  if (data != nullptr) {
+    UnmapViewOfFile(data);
+  }
+  if (mapping != nullptr) {
+    CloseHandle(mapping);
+    mapping = nullptr;
+  }
+#else
+  if (data != nullptr) {
+    munmap(const_cast<std::uint8_t*>(data), size);
+  }
+#endif
+  data = nullptr;
+  size = 0;
+  isOpen = false;
+}
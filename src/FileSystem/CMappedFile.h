@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <string>
+
+/**
+ * A whole file mapped read-only into memory.
+ */
+class CMappedFile {
+ public:
+  CMappedFile() = default;
+  explicit CMappedFile(const std::string& path);
+  ~CMappedFile();
+
+  CMappedFile(const CMappedFile&) = delete;
+  CMappedFile& operator=(const CMappedFile&) = delete;
+  CMappedFile(CMappedFile&& other) noexcept;
+  CMappedFile& operator=(CMappedFile&& other) noexcept;
+
+  /**
+   * @return true if the file could be mapped, empty files are open but
+   *   have no data
+   */
+  bool IsOpen() const { return isOpen; }
+  std::span<const std::uint8_t> Data() const { return {data, size}; }
+  std::size_t Size() const { return size; }
+
+ private:
+  void Close();
+
+  const std::uint8_t* data = nullptr;
+  std::size_t size = 0;
+  bool isOpen = false;
+#ifdef _WIN32
+  void* mapping = nullptr;
+#endif
+};
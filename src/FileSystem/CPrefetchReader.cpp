@@ -0,0 +1,230 @@
+#include "CPrefetchReader.h"
+
+#include <algorithm>
+#include <optional>
+#include <unordered_set>
+
+#include "CVirtualFileSystem.h"
+
+CPrefetchReader::CPrefetchReader(BulkRead read, MapRead map, std::size_t maxQueued)
+    : read(std::move(read)), map(std::move(map)), maxQueued(std::max<std::size_t>(1, maxQueued)) {
+  thread = std::thread(&CPrefetchReader::Run, this);
+}
+
+CPrefetchReader::CPrefetchReader(std::shared_ptr<IArchive> archive, std::size_t maxQueued)
+    : CPrefetchReader(
+          [archive](const std::vector<std::size_t>& fids, const IArchive::FileVisitor& visitor) {
+            return archive->GetFiles(fids, visitor);
+          },
+          [archive](std::size_t fid, IArchive::FileView& view) {
+            return archive->GetMappedView(fid, view);
+          },
+          maxQueued) {}
+
+CPrefetchReader::CPrefetchReader(const CVirtualFileSystem& vfs, std::size_t maxQueued)
+    : CPrefetchReader(
+          [&vfs](const std::vector<std::size_t>& fids, const IArchive::FileVisitor& visitor) {
+            return vfs.GetFiles(fids, visitor);
+          },
+          [&vfs](std::size_t fid, IArchive::FileView& view) {
+            return vfs.GetMappedView(fid, view);
+          },
+          maxQueued) {}
+
+CPrefetchReader::~CPrefetchReader() {
+  {
+    const std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  requestsChanged.notify_all();
+  filesChanged.notify_all();
+  thread.join();
+}
+
+void CPrefetchReader::Submit(std::vector<std::size_t> fids) {
+  // Every file is handed out once, however often it was asked for.
+  std::sort(fids.begin(), fids.end());
+  fids.erase(std::unique(fids.begin(), fids.end()), fids.end());
+  if (fids.empty()) {
+    return;
+  }
+
+  {
+    const std::lock_guard<std::mutex> lock(mutex);
+    pending += fids.size();
+    requests.push_back(std::move(fids));
+  }
+  requestsChanged.notify_one();
+}
+
+std::future<IArchive::FileView> CPrefetchReader::Read(std::size_t fid) {
+  std::promise<IArchive::FileView> promise;
+  auto future = promise.get_future();
+
+  {
+    const std::lock_guard<std::mutex> lock(mutex);
+    reads.push_back({fid, std::move(promise)});
+  }
+  // The I/O thread may wait for work or for room in the queue.
+  requestsChanged.notify_one();
+  filesChanged.notify_all();
+  return future;
+}
+
+bool CPrefetchReader::Next(File& file) {
+  std::unique_lock<std::mutex> lock(mutex);
+  filesChanged.wait(lock, [this]() { return !files.empty() || (closed && pending == 0); });
+  if (files.empty()) {
+    return false;
+  }
+
+  file = std::move(files.front());
+  files.pop_front();
+  lock.unlock();
+
+  // There's room for the I/O thread again.
+  filesChanged.notify_all();
+  return true;
+}
+
+void CPrefetchReader::Close() {
+  {
+    const std::lock_guard<std::mutex> lock(mutex);
+    closed = true;
+  }
+  filesChanged.notify_all();
+}
+
+CPrefetchReader::PushResult CPrefetchReader::Push(File& file) {
+  std::unique_lock<std::mutex> lock(mutex);
+  filesChanged.wait(lock, [this]() {
+    return files.size() < maxQueued || stopping || !reads.empty();
+  });
+  if (stopping) {
+    return PushResult::Stopping;
+  }
+  if (files.size() >= maxQueued) {
+    return PushResult::ReadWaiting;
+  }
+
+  files.push_back(std::move(file));
+  pending--;
+  lock.unlock();
+
+  filesChanged.notify_all();
+  return PushResult::Pushed;
+}
+
+void CPrefetchReader::ServeReads() {
+  std::deque<ReadRequest> waiting;
+  {
+    const std::lock_guard<std::mutex> lock(mutex);
+    waiting.swap(reads);
+  }
+
+  for (auto& request : waiting) {
+    IArchive::FileView view;
+    if (!map || !map(request.fid, view)) {
+      read({request.fid}, [&view](std::size_t, std::span<const std::uint8_t> par_data) {
+        view.Assign(std::vector<std::uint8_t>(par_data.begin(), par_data.end()));
+        return true;
+      });
+    }
+    request.promise.set_value(std::move(view));
+  }
+}
+
+void CPrefetchReader::ReadBatch(const std::vector<std::size_t>& fids) {
+  // Pushes file, the Read() calls that come in while the queue is full are served meanwhile.
+  const auto push = [this](File& file) {
+    for (;;) {
+      const PushResult result = Push(file);
+      if (result != PushResult::ReadWaiting) {
+        return result == PushResult::Pushed;
+      }
+      ServeReads();
+    }
+  };
+
+  // Whatever can be mapped needs no reading at all.
+  std::unordered_set<std::size_t> done;
+  std::vector<std::size_t> unmapped;
+  for (const std::size_t fid : fids) {
+    File file{fid, true, {}};
+    if (!map || !map(fid, file.data)) {
+      unmapped.push_back(fid);
+      continue;
+    }
+
+    done.insert(fid);
+    if (!push(file)) {
+      return;
+    }
+  }
+
+  // GetFiles() skips broken files, retrying them one by one would only fail again (and decode
+  // a whole solid folder each time). It is only interrupted for a Read() while the queue is
+  // full, the source can't serve that from within the visitor, and resumed with the rest.
+  std::vector<std::size_t> remaining = std::move(unmapped);
+  while (!remaining.empty()) {
+    std::optional<File> held;
+    bool stopped = false;
+    read(remaining, [&](std::size_t fid, std::span<const std::uint8_t> data) {
+      done.insert(fid);
+      File file{fid, true, {}};
+      file.data.Assign(std::vector<std::uint8_t>(data.begin(), data.end()));
+
+      const PushResult result = Push(file);
+      if (result == PushResult::ReadWaiting) {
+        held = std::move(file);
+      }
+      stopped = result == PushResult::Stopping;
+      return result == PushResult::Pushed;
+    });
+    if (stopped) {
+      return;
+    }
+    if (!held) {
+      break;
+    }
+
+    ServeReads();
+    if (!push(*held)) {
+      return;
+    }
+    remaining.erase(std::remove_if(remaining.begin(), remaining.end(),
+                                   [&done](std::size_t fid) { return done.count(fid) != 0; }),
+                    remaining.end());
+  }
+
+  for (const std::size_t fid : fids) {
+    File file{fid, false, {}};
+    if (done.count(fid) == 0 && !push(file)) {
+      return;
+    }
+  }
+}
+
+void CPrefetchReader::Run() {
+  for (;;) {
+    std::vector<std::size_t> fids;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      requestsChanged.wait(lock,
+                           [this]() { return !requests.empty() || !reads.empty() || stopping; });
+      if (stopping) {
+        return;
+      }
+      if (reads.empty()) {
+        fids = std::move(requests.front());
+        requests.pop_front();
+      }
+    }
+
+    // Single reads go first, a batch checks for them between its files.
+    ServeReads();
+    if (!fids.empty()) {
+      ReadBatch(fids);
+    }
+  }
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "IArchive.h"
+
+class CVirtualFileSystem;
+
+/**
+ * Reads files on an I/O thread while the caller works on the ones read
+ * before, so decompression overlaps with decoding.
+ *
+ * Files that can be mapped (see IArchive::GetMappedView()) are, the rest
+ * is read with GetFiles(). They wait in a queue of at most
+ * maxQueued files until Next() takes them; the I/O thread stalls while the
+ * queue is full. The source must not be used by anyone else while the
+ * reader is alive.
+ */
+class CPrefetchReader {
+ public:
+  // Reads fids and hands them to the visitor, like IArchive::GetFiles().
+  using BulkRead = std::function<bool(const std::vector<std::size_t>& fids,
+                                      const IArchive::FileVisitor& visitor)>;
+  // Maps a file without reading it, like IArchive::GetMappedView().
+  using MapRead = std::function<bool(std::size_t fid, IArchive::FileView& view)>;
+
+  struct File {
+    std::size_t fid;
+    bool ok;  // false if it couldn't be read, data is empty then
+    IArchive::FileView data;
+  };
+
+  CPrefetchReader(BulkRead read, MapRead map = nullptr, std::size_t maxQueued = 16);
+  explicit CPrefetchReader(std::shared_ptr<IArchive> archive, std::size_t maxQueued = 16);
+  // fids are indices into CVirtualFileSystem::Files().
+  explicit CPrefetchReader(const CVirtualFileSystem& vfs, std::size_t maxQueued = 16);
+  ~CPrefetchReader();
+
+  CPrefetchReader(const CPrefetchReader&) = delete;
+  CPrefetchReader& operator=(const CPrefetchReader&) = delete;
+
+  /**
+   * Queues files for Next(), they come out in the order that's cheapest for
+   * the source, not necessarily the order given.
+   */
+  void Submit(std::vector<std::size_t> fids);
+  /**
+   * Reads a single file, bypassing the queue of Next(). It is served before
+   * the submitted files, also while the queue is full.
+   * @return the contents, empty if the file couldn't be read
+   */
+  std::future<IArchive::FileView> Read(std::size_t fid);
+  /**
+   * Blocks until the next submitted file was read.
+   * @return false once Close() was called and every file was handed out
+   */
+  bool Next(File& file);
+  /**
+   * No more Submit() calls follow, lets Next() return false at the end.
+   */
+  void Close();
+
+ private:
+  struct ReadRequest {
+    std::size_t fid;
+    std::promise<IArchive::FileView> promise;
+  };
+
+  enum class PushResult { Pushed, ReadWaiting, Stopping };
+
+  void Run();
+  void ReadBatch(const std::vector<std::size_t>& fids);
+  // Answers every waiting Read().
+  void ServeReads();
+  // Blocks while the queue is full, gives up when a Read() comes in meanwhile
+  // (file is left as is then) or the reader is shutting down.
+  PushResult Push(File& file);
+
+  BulkRead read;
+  MapRead map;
+  const std::size_t maxQueued;
+
+  std::mutex mutex;
+  std::condition_variable requestsChanged;
+  std::condition_variable filesChanged;
+  std::deque<std::vector<std::size_t>> requests;  // Submit() batches
+  std::deque<ReadRequest> reads;
+  std::deque<File> files;
+  std::size_t pending = 0;  // submitted, not yet in files
+  bool closed = false;
+  bool stopping = false;
+
+  std::thread thread;
+};
@@ -6,6 +6,8 @@
 #include <stdexcept>
 #include <cstring>  //memcpy
 
+#include "CArchiveIndexCache.h"
+#include "../parallel.h"
 #include "../string_util.h"
 
 #include "simdutf.h"
@@ -93,38 +95,24 @@ CSevenZipArchive::CSevenZipArchive(const std::string& name) : IArchive(name), is
   allocImp.Free = SzFree;
   allocTempImp.Alloc = SzAllocTemp;
   allocTempImp.Free = SzFreeTemp;
-  constexpr const size_t kInputBufSize(static_cast<size_t>(1) << 18);
 
   SzArEx_Init(&db);
 
-#ifdef _WIN32
-  WRes wres = InFile_OpenW(&archiveStream.file, s2ws(name).c_str());
-#else
-  WRes const wres = InFile_Open(&archiveStream.file, name.c_str());
-#endif
-  if (wres != 0) {
-    spdlog::error("OS error opening '{}', error was: {}", name, strerror(wres));
+  std::vector<CArchiveIndexCache::Entry> cached;
+  if (CArchiveIndexCache::Load(name, CArchiveIndexCache::Type::SevenZip, cached)) {
+    // The headers only get parsed once a file is read.
+    fileEntries.reserve(cached.size());
+    for (auto& entry : cached) {
+      lcNameIndex.emplace(std::move(entry.lowerName), fileEntries.size());
+      fileEntries.push_back({static_cast<int>(entry.id), static_cast<std::size_t>(entry.size),
+                             std::move(entry.name), static_cast<int>(entry.mode)});
+    }
     return;
   }
 
-  FileInStream_CreateVTable(&archiveStream);
-  archiveStream.wres = 0;
-
-  LookToRead2_CreateVTable(&lookStream, False);
-  lookStream.realStream = &archiveStream.vt;
-  lookStream.buf = static_cast<Byte*>(ISzAlloc_Alloc(&allocImp, kInputBufSize));
-  lookStream.bufSize = kInputBufSize;
-  LookToRead2_Init(&lookStream);
-
-  CrcGenerateTable();
-  SzArEx_Init(&db);
-
-  SRes res = SzArEx_Open(&db, &lookStream.vt, &allocImp, &allocTempImp);
-  if (res != SZ_OK) {
-    spdlog::error("7zip error opening '{}', error was: {}", name, strerror(res));
+  if (!EnsureOpen()) {
     return;
   }
-  isOpen = true;
 
   // Get contents of archive and store name->int mapping
   for (std::size_t i = 0; i < db.NumFiles; ++i) {
@@ -134,12 +122,11 @@ CSevenZipArchive::CSevenZipArchive(const std::string& name) : IArchive(name), is
 
     auto name = get_file_name(&db, i);
     if (!name) {
-      spdlog::error("Error getting filename in Archive: {} {}, file skipped", GetErrorStr(res),
-                    res);
+      spdlog::error("Error getting filename in Archive: {}, file skipped", GetArchiveName());
       continue;
     }
 
-    const std::string lower_name = to_lower(name.value());
+    std::string lower_name = to_lower(name.value());
 
     if (lcNameIndex.find(lower_name) != lcNameIndex.end()) {
       spdlog::debug("7zip: skipping '{}' it's already known", lower_name);
@@ -159,26 +146,93 @@ CSevenZipArchive::CSevenZipArchive(const std::string& name) : IArchive(name), is
       }
     }
 
-    lcNameIndex.emplace(to_lower(fd.origName), fileEntries.size());
+    cached.push_back({static_cast<std::uint64_t>(fd.fp), fd.size, 0,
+                      static_cast<std::uint32_t>(fd.mode), fd.origName, lower_name});
+    lcNameIndex.emplace(std::move(lower_name), fileEntries.size());
     fileEntries.emplace_back(fd);
   }
+
+  CArchiveIndexCache::Save(name, CArchiveIndexCache::Type::SevenZip, cached);
+}
+
+bool CSevenZipArchive::EnsureOpen() {
+  if (isOpen || openFailed) {
+    return isOpen;
+  }
+  openFailed = true;
+
+  if (!OpenStream(archiveStream, lookStream)) {
+    return false;
+  }
+
+  CrcGenerateTable();
+
+  const SRes res = SzArEx_Open(&db, &lookStream.vt, &allocImp, &allocTempImp);
+  if (res != SZ_OK) {
+    spdlog::error("7zip error opening '{}', error was: {}", GetArchiveName(), GetErrorStr(res));
+    CloseStream(archiveStream, lookStream);
+    return false;
+  }
+
+  openFailed = false;
+  isOpen = true;
+  return true;
 }
 
 CSevenZipArchive::~CSevenZipArchive() {
   if (outBuffer != nullptr) {
     IAlloc_Free(&allocImp, outBuffer);
   }
+  for (auto& stream : streams) {
+    IAlloc_Free(&allocImp, stream->outBuffer);
+    if (stream->isOpen) {
+      CloseStream(stream->archiveStream, stream->lookStream);
+    }
+  }
   if (isOpen) {
-    File_Close(&archiveStream.file);
-    ISzAlloc_Free(&allocImp, lookStream.buf);
+    CloseStream(archiveStream, lookStream);
   }
   SzArEx_Free(&db, &allocImp);
   SzFree(nullptr, tempBuf);
 }
 
+bool CSevenZipArchive::OpenStream(CFileInStream& fileStream, CLookToRead2& look) {
+  constexpr const size_t kInputBufSize(static_cast<size_t>(1) << 18);
+
+#ifdef _WIN32
+  WRes wres = InFile_OpenW(&fileStream.file, s2ws(GetArchiveName()).c_str());
+#else
+  WRes const wres = InFile_Open(&fileStream.file, GetArchiveName().c_str());
+#endif
+  if (wres != 0) {
+    spdlog::error("OS error opening '{}', error was: {}", GetArchiveName(), strerror(wres));
+    return false;
+  }
+
+  FileInStream_CreateVTable(&fileStream);
+  fileStream.wres = 0;
+
+  LookToRead2_CreateVTable(&look, False);
+  look.realStream = &fileStream.vt;
+  look.buf = static_cast<Byte*>(ISzAlloc_Alloc(&allocImp, kInputBufSize));
+  look.bufSize = kInputBufSize;
+  LookToRead2_Init(&look);
+  return true;
+}
+
+void CSevenZipArchive::CloseStream(CFileInStream& fileStream, CLookToRead2& look) {
+  File_Close(&fileStream.file);
+  ISzAlloc_Free(&allocImp, look.buf);
+  look.buf = nullptr;
+}
+
 std::size_t CSevenZipArchive::NumFiles() const { return fileEntries.size(); }
 
 bool CSevenZipArchive::GetFile(std::size_t fid, std::vector<std::uint8_t>& buffer) {
+  if (!EnsureOpen()) {
+    return false;
+  }
+
   // Get 7zip to decompress it
   size_t offset = 0;
   size_t outSizeProcessed = 0;
@@ -196,6 +250,225 @@ bool CSevenZipArchive::GetFile(std::size_t fid, std::vector<std::uint8_t>& buffe
   return false;
 }
 
+SRes CSevenZipArchive::DecodeFolder(UInt32 folderIndex) {
+  if (outBuffer != nullptr && blockIndex == folderIndex) {
+    return SZ_OK;
+  }
+
+  // Same buffer and bookkeeping as SzArEx_Extract, so GetFile() can reuse the block.
+  blockIndex = folderIndex;
+  const SRes res = DecodeFolderTo(folderIndex, &lookStream.vt, outBuffer, outBufferSize);
+  if (res != SZ_OK) {
+    blockIndex = 0xFFFFFFFF;
+  }
+  return res;
+}
+
+SRes CSevenZipArchive::DecodeFolderTo(UInt32 folderIndex, ILookInStream* stream, Byte*& buffer,
+                                      size_t& bufferSize) {
+  IAlloc_Free(&allocImp, buffer);
+  buffer = nullptr;
+  bufferSize = 0;
+
+  const UInt64 unpackSizeSpec = SzAr_GetFolderUnpackSize(&db.db, folderIndex);
+  const auto unpackSize = static_cast<size_t>(unpackSizeSpec);
+  if (unpackSize != unpackSizeSpec) {
+    return SZ_ERROR_MEM;
+  }
+
+  if (unpackSize != 0) {
+    buffer = static_cast<Byte*>(ISzAlloc_Alloc(&allocImp, unpackSize));
+    if (buffer == nullptr) {
+      return SZ_ERROR_MEM;
+    }
+  }
+  bufferSize = unpackSize;
+
+  const SRes res = SzAr_DecodeFolder(&db.db, folderIndex, stream, db.dataPos, buffer,
+                                     unpackSize, &allocTempImp);
+  if (res != SZ_OK) {
+    IAlloc_Free(&allocImp, buffer);
+    buffer = nullptr;
+    bufferSize = 0;
+  }
+  return res;
+}
+
+bool CSevenZipArchive::VisitFile(std::size_t fid, const Byte* folderData, size_t folderSize,
+                                 const FileVisitor& visitor, bool& stopped) {
+  const UInt32 fp = fileEntries[fid].fp;
+  const UInt32 folderIndex = db.FileToFolder[fp];
+
+  // Empty files don't have a folder.
+  if (folderIndex == static_cast<UInt32>(-1)) {
+    stopped = !visitor(fid, {});
+    return true;
+  }
+
+  const UInt64 unpackPos = db.UnpackPositions[fp];
+  const auto offset =
+      static_cast<size_t>(unpackPos - db.UnpackPositions[db.FolderToFile[folderIndex]]);
+  const auto size = static_cast<size_t>(db.UnpackPositions[fp + 1] - unpackPos);
+  if (offset + size > folderSize) {
+    spdlog::error("Error extracting {}: {}", fileEntries[fid].origName,
+                  GetErrorStr(SZ_ERROR_FAIL));
+    return false;
+  }
+
+  if (SzBitWithVals_Check(&db.CRCs, fp) && CrcCalc(folderData + offset, size) != db.CRCs.Vals[fp]) {
+    spdlog::error("Error extracting {}: {}", fileEntries[fid].origName,
+                  GetErrorStr(SZ_ERROR_CRC));
+    return false;
+  }
+
+  stopped = !visitor(fid, {folderData + offset, size});
+  return true;
+}
+
+bool CSevenZipArchive::GetFiles(const std::vector<std::size_t>& fids, const FileVisitor& visitor) {
+  if (!EnsureOpen()) {
+    return false;
+  }
+
+  std::vector<std::size_t> sorted;
+  sorted.reserve(fids.size());
+  for (const std::size_t fid : fids) {
+    if (!IsFileId(fid)) {
+      return false;
+    }
+    sorted.push_back(fid);
+  }
+
+  // By folder, then by position inside of it.
+  std::sort(sorted.begin(), sorted.end(), [this](std::size_t a, std::size_t b) {
+    const UInt32 fpA = fileEntries[a].fp;
+    const UInt32 fpB = fileEntries[b].fp;
+    if (db.FileToFolder[fpA] != db.FileToFolder[fpB]) {
+      return db.FileToFolder[fpA] < db.FileToFolder[fpB];
+    }
+    return db.UnpackPositions[fpA] < db.UnpackPositions[fpB];
+  });
+
+  if (parallelDecode && ups::worker_count() > 1) {
+    return GetFilesParallel(sorted, visitor);
+  }
+
+  return GetFilesSerial(sorted, visitor);
+}
+
+bool CSevenZipArchive::GetFilesSerial(const std::vector<std::size_t>& sorted,
+                                      const FileVisitor& visitor) {
+  // A folder that fails to decode fails all of its files, it isn't retried for each of them.
+  bool result = true;
+  UInt32 failedFolder = static_cast<UInt32>(-1);
+  for (const std::size_t fid : sorted) {
+    const UInt32 folderIndex = db.FileToFolder[fileEntries[fid].fp];
+    if (folderIndex != static_cast<UInt32>(-1)) {
+      if (folderIndex == failedFolder) {
+        continue;
+      }
+
+      const SRes res = DecodeFolder(folderIndex);
+      if (res != SZ_OK) {
+        spdlog::error("Error extracting {}: {}", fileEntries[fid].origName, GetErrorStr(res));
+        failedFolder = folderIndex;
+        result = false;
+        continue;
+      }
+    }
+
+    bool stopped = false;
+    if (!VisitFile(fid, outBuffer, outBufferSize, visitor, stopped)) {
+      result = false;
+    }
+    if (stopped) {
+      return false;
+    }
+  }
+
+  return result;
+}
+
+bool CSevenZipArchive::GetFilesParallel(const std::vector<std::size_t>& sorted,
+                                        const FileVisitor& visitor) {
+  struct FolderRun {
+    UInt32 folderIndex;
+    std::size_t begin;
+    std::size_t end;
+    SRes res;
+  };
+
+  // sorted is ordered by folder already, so every folder is one run of fids.
+  std::vector<FolderRun> runs;
+  for (std::size_t i = 0; i < sorted.size(); i++) {
+    const UInt32 folderIndex = db.FileToFolder[fileEntries[sorted[i]].fp];
+    if (runs.empty() || runs.back().folderIndex != folderIndex) {
+      runs.push_back({folderIndex, i, i, SZ_OK});
+    }
+    runs.back().end = i + 1;
+  }
+
+  // Only as many folders as there are workers are held in memory at once. If some streams can't
+  // be opened (out of file handles) the ones that did do the work, without any the shared one.
+  const std::size_t wanted = std::min(ups::worker_count(), runs.size());
+  while (streams.size() < wanted) {
+    auto stream = std::make_unique<StreamContext>();
+    stream->isOpen = OpenStream(stream->archiveStream, stream->lookStream);
+    if (!stream->isOpen) {
+      spdlog::warn("{}: opened {} of {} streams for parallel decoding", GetArchiveName(),
+                   streams.size(), wanted);
+      break;
+    }
+    streams.push_back(std::move(stream));
+  }
+  if (streams.empty()) {
+    return GetFilesSerial(sorted, visitor);
+  }
+  const std::size_t batchSize = std::min(streams.size(), wanted);
+
+  bool result = true;
+  bool stopped = false;
+  for (std::size_t first = 0; first < runs.size() && !stopped; first += batchSize) {
+    const std::size_t count = std::min(batchSize, runs.size() - first);
+
+    ups::parallel_for(count, [&](std::size_t par_i) {
+      auto& run = runs[first + par_i];
+      if (run.folderIndex == static_cast<UInt32>(-1)) {
+        return;
+      }
+      auto& stream = *streams[par_i];
+      run.res = DecodeFolderTo(run.folderIndex, &stream.lookStream.vt, stream.outBuffer,
+                               stream.outBufferSize);
+    });
+
+    for (std::size_t i = 0; i < count && !stopped; i++) {
+      const auto& run = runs[first + i];
+      const auto& stream = *streams[i];
+      if (run.res != SZ_OK) {
+        spdlog::error("Error extracting {}: {}", fileEntries[sorted[run.begin]].origName,
+                      GetErrorStr(run.res));
+        result = false;
+        continue;
+      }
+
+      for (std::size_t j = run.begin; j < run.end && !stopped; j++) {
+        if (!VisitFile(sorted[j], stream.outBuffer, stream.outBufferSize, visitor, stopped)) {
+          result = false;
+        }
+      }
+    }
+  }
+
+  // Don't keep a decompressed folder per worker around.
+  for (auto& stream : streams) {
+    IAlloc_Free(&allocImp, stream->outBuffer);
+    stream->outBuffer = nullptr;
+    stream->outBufferSize = 0;
+  }
+
+  return result && !stopped;
+}
+
 void CSevenZipArchive::FileInfo(std::size_t fid, std::string& par_name, int& par_size,
                                 int& par_mode) const {
   par_name = fileEntries[fid].origName;
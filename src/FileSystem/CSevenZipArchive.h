@@ -2,6 +2,7 @@
 #pragma once
 
 #include <cstdint>
+#include <memory>
 #include <vector>
 #include <string>
 #include <optional>
@@ -24,12 +25,53 @@ class CSevenZipArchive : public IArchive {
   virtual void FileInfo(std::size_t fid, std::string& name, int& size, int& mode) const override;
 
   virtual bool GetFile(std::size_t fid, std::vector<std::uint8_t>& buffer) override;
+  /**
+   * Sorts fids by 7z folder (solid block) and decompresses every folder once.
+   */
+  virtual bool GetFiles(const std::vector<std::size_t>& fids, const FileVisitor& visitor) override;
+
+  /**
+   * Lets GetFiles() decompress distinct folders concurrently, every worker
+   * thread reads the archive through its own stream. Files are still handed
+   * to the visitor one by one on the calling thread.
+   */
+  void SetParallelDecode(bool enable) { parallelDecode = enable; }
 
 #if 0
   virtual unsigned GetCrc32(std::size_t fid);
 #endif
 
  private:
+  // A file handle with its own look-ahead buffer, for decoding on another thread.
+  struct StreamContext {
+    CFileInStream archiveStream{};
+    CLookToRead2 lookStream{};
+    Byte* outBuffer = nullptr;
+    size_t outBufferSize = 0;
+    bool isOpen = false;
+  };
+
+  // Parses the archive headers, which is put off while the file table comes from the cache.
+  bool EnsureOpen();
+  bool OpenStream(CFileInStream& fileStream, CLookToRead2& look);
+  void CloseStream(CFileInStream& fileStream, CLookToRead2& look);
+
+  // Decompresses folderIndex into outBuffer, unless it already is there.
+  SRes DecodeFolder(UInt32 folderIndex);
+  // Decompresses folderIndex into buffer, replacing what was in it.
+  SRes DecodeFolderTo(UInt32 folderIndex, ILookInStream* stream, Byte*& buffer,
+                      size_t& bufferSize);
+  // Cuts fid out of its decompressed folder, checks it and hands it to visitor. Returns false if
+  // the file is broken, stopped is set when the visitor returned false.
+  bool VisitFile(std::size_t fid, const Byte* folderData, size_t folderSize,
+                 const FileVisitor& visitor, bool& stopped);
+  // GetFiles() with sorted by folder, on the shared stream or one stream per worker.
+  bool GetFilesSerial(const std::vector<std::size_t>& sorted, const FileVisitor& visitor);
+  bool GetFilesParallel(const std::vector<std::size_t>& sorted, const FileVisitor& visitor);
+
+  bool parallelDecode = false;
+  std::vector<std::unique_ptr<StreamContext>> streams;
+
   UInt32 blockIndex = 0xFFFFFFFF;
   Byte* outBuffer = nullptr;
   size_t outBufferSize = 0;
@@ -38,7 +80,7 @@ class CSevenZipArchive : public IArchive {
     int fp;
     std::size_t size;
     std::string origName;
-    int mode;
+    int mode = 0644;
   };
   static const char* GetErrorStr(int res);
 
@@ -53,4 +95,5 @@ class CSevenZipArchive : public IArchive {
   ISzAlloc allocTempImp{};
 
   bool isOpen;
+  bool openFailed = false;
 };
\ No newline at end of file
@@ -0,0 +1,157 @@
+#include "CVirtualFileSystem.h"
+
+#include <algorithm>
+#include <filesystem>
+
+#include "CDirectoryArchive.h"
+#include "CSevenZipArchive.h"
+#include "CZipArchive.h"
+
+#include "../string_util.h"
+
+#include "spdlog/spdlog.h"
+
+std::shared_ptr<IArchive> CVirtualFileSystem::OpenArchive(
+    const std::string& path, const std::vector<std::string>& prefixes) {
+  const auto absPath = std::filesystem::absolute(path);
+  if (std::filesystem::is_directory(absPath)) {
+    return std::make_shared<CDirectoryArchive>(path, prefixes);
+  }
+
+  const auto ext = to_lower(absPath.extension().string());
+  if (ext == ".7z" || ext == ".sd7") {
+    auto sevenzip = std::make_shared<CSevenZipArchive>(path);
+    sevenzip->SetParallelDecode(true);
+    return sevenzip;
+  }
+  if (ext == ".zip" || ext == ".sdz") {
+    return std::make_shared<CZipArchive>(path);
+  }
+
+  spdlog::error("Unknown archive '{}'", absPath.string());
+  return nullptr;
+}
+
+bool CVirtualFileSystem::Mount(const std::string& path, const std::vector<std::string>& prefixes) {
+  auto archive = OpenArchive(path, prefixes);
+  if (!archive || archive->NumFiles() == 0) {
+    return false;
+  }
+
+  Mount(archive);
+  return true;
+}
+
+void CVirtualFileSystem::Mount(const std::shared_ptr<IArchive>& archive) {
+  archives.push_back(archive);
+
+  files.reserve(files.size() + archive->NumFiles());
+  for (std::size_t fid = 0; fid < archive->NumFiles(); ++fid) {
+    std::string name;
+    int size = 0;
+    int mode = 0;
+    archive->FileInfo(fid, name, size, mode);
+
+    auto lcName = NormalizePath(name);
+    const auto it = lcNameIndex.find(lcName);
+    if (it != lcNameIndex.end()) {
+      // Overrides whatever was mounted before.
+      files[it->second].archive = archive;
+      files[it->second].fid = fid;
+      continue;
+    }
+
+    lcNameIndex.emplace(lcName, files.size());
+    files.push_back({std::move(lcName), archive, fid});
+  }
+
+  spdlog::debug("Mounted '{}', {} files in the VFS", archive->GetArchiveName(), files.size());
+}
+
+void CVirtualFileSystem::Clear() {
+  archives.clear();
+  files.clear();
+  lcNameIndex.clear();
+}
+
+std::string CVirtualFileSystem::NormalizePath(const std::string& filePath) {
+  auto result = to_lower(filePath);
+  std::replace(result.begin(), result.end(), '\\', '/');
+  return result;
+}
+
+const CVirtualFileSystem::FileData* CVirtualFileSystem::Find(const std::string& filePath) const {
+  const auto it = lcNameIndex.find(NormalizePath(filePath));
+  if (it == lcNameIndex.end()) {
+    return nullptr;
+  }
+  return &files[it->second];
+}
+
+bool CVirtualFileSystem::GetFile(const std::string& filePath,
+                                 std::vector<std::uint8_t>& buffer) const {
+  const auto* file = Find(filePath);
+  if (file == nullptr) {
+    return false;
+  }
+  return file->archive->GetFile(file->fid, buffer);
+}
+
+bool CVirtualFileSystem::GetFileView(const std::string& filePath,
+                                     IArchive::FileView& view) const {
+  const auto* file = Find(filePath);
+  if (file == nullptr) {
+    return false;
+  }
+  return file->archive->GetFileView(file->fid, view);
+}
+
+bool CVirtualFileSystem::GetMappedView(std::size_t index, IArchive::FileView& view) const {
+  if (index >= files.size()) {
+    return false;
+  }
+  return files[index].archive->GetMappedView(files[index].fid, view);
+}
+
+bool CVirtualFileSystem::GetFiles(const std::vector<std::size_t>& indices,
+                                  const IArchive::FileVisitor& visitor) const {
+  // Archive fid -> VFS index, per archive.
+  std::unordered_map<IArchive*, std::unordered_map<std::size_t, std::size_t>> byArchive;
+  for (const std::size_t index : indices) {
+    if (index >= files.size()) {
+      return false;
+    }
+    byArchive[files[index].archive.get()].emplace(files[index].fid, index);
+  }
+
+  // Mount order, so the reads stay deterministic.
+  bool result = true;
+  bool stopped = false;
+  for (const auto& archive : archives) {
+    const auto it = byArchive.find(archive.get());
+    if (it == byArchive.end()) {
+      continue;
+    }
+
+    const auto& toIndex = it->second;
+    std::vector<std::size_t> fids;
+    fids.reserve(toIndex.size());
+    for (const auto& [fid, index] : toIndex) {
+      fids.push_back(fid);
+    }
+    std::sort(fids.begin(), fids.end());
+
+    const bool ok = archive->GetFiles(
+        fids, [&](std::size_t fid, std::span<const std::uint8_t> data) {
+          stopped = !visitor(toIndex.at(fid), data);
+          return !stopped;
+        });
+    if (stopped) {
+      return false;
+    }
+    // Broken files were skipped, the other archives still get read.
+    result = result && ok;
+  }
+
+  return result;
+}
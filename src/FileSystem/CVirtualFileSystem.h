@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "IArchive.h"
+
+/**
+ * Several archives mounted on top of each other, for example a base TA
+ * archive with a mod .sdd over it.
+ *
+ * Every file name is resolved through one merged, lower-case index; a file
+ * in an archive mounted later hides the same file in archives mounted
+ * before it.
+ */
+class CVirtualFileSystem {
+ public:
+  struct FileData {
+    std::string name;  // lower-case, using forward-slashes
+    std::shared_ptr<IArchive> archive;
+    std::size_t fid;
+  };
+
+  CVirtualFileSystem() = default;
+
+  /**
+   * Opens a directory, .7z/.sd7 or .zip/.sdz archive.
+   * @param prefixes passed on to CDirectoryArchive, ignored otherwise
+   * @return nullptr if the type is unknown
+   */
+  static std::shared_ptr<IArchive> OpenArchive(const std::string& path,
+                                               const std::vector<std::string>& prefixes = {});
+
+  /**
+   * Opens path and mounts it on top of everything mounted so far.
+   * @return false if the archive couldn't be opened or is empty
+   */
+  bool Mount(const std::string& path, const std::vector<std::string>& prefixes = {});
+  void Mount(const std::shared_ptr<IArchive>& archive);
+  void Clear();
+
+  const std::vector<std::shared_ptr<IArchive>>& Archives() const { return archives; }
+
+  /**
+   * @return The amount of distinct files over all archives
+   */
+  std::size_t NumFiles() const { return files.size(); }
+  const FileData& File(std::size_t index) const { return files[index]; }
+  const std::vector<FileData>& Files() const { return files; }
+
+  /**
+   * @param filePath VFS path to the file, for example "objects3d/arm.3do"
+   * @return The winning entry for filePath, nullptr if no archive has it
+   */
+  const FileData* Find(const std::string& filePath) const;
+  bool FileExists(const std::string& filePath) const { return Find(filePath) != nullptr; }
+  bool GetFile(const std::string& filePath, std::vector<std::uint8_t>& buffer) const;
+  // See IArchive::GetFileView(), mapped when the archive can.
+  bool GetFileView(const std::string& filePath, IArchive::FileView& view) const;
+  // See IArchive::GetMappedView(), index is into Files().
+  bool GetMappedView(std::size_t index, IArchive::FileView& view) const;
+
+  /**
+   * Reads many files with IArchive::GetFiles(), grouped by archive.
+   * @param indices into Files(), the visitor gets these back as fid
+   */
+  bool GetFiles(const std::vector<std::size_t>& indices,
+                const IArchive::FileVisitor& visitor) const;
+
+  static std::string NormalizePath(const std::string& filePath);
+
+ private:
+  std::vector<std::shared_ptr<IArchive>> archives;
+  std::vector<FileData> files;
+  std::unordered_map<std::string, std::size_t> lcNameIndex;
+};
@@ -10,21 +10,34 @@
 #include "mz_strm_os.h"
 #include "mz_zip.h"
 
+#include "CArchiveIndexCache.h"
+#include "CMappedFile.h"
 #include "../string_util.h"
 
 #include "spdlog/spdlog.h"
 
-CZipArchive::CZipArchive(const std::string& archiveName)
-    : IArchive(archiveName), streamHandle(mz_stream_os_create()), zipHandle(mz_zip_create()) {
-  if (mz_stream_open(streamHandle, archiveName.c_str(), MZ_OPEN_MODE_READ) != MZ_OK) {
-    spdlog::error("minizip: Error opening: {}", archiveName);
+CZipArchive::CZipArchive(const std::string& archiveName) : IArchive(archiveName) {
+  std::vector<CArchiveIndexCache::Entry> cached;
+  if (CArchiveIndexCache::Load(archiveName, CArchiveIndexCache::Type::Zip, cached)) {
+    // The central directory only gets read once a file is.
+    fileData.reserve(cached.size());
+    for (auto& entry : cached) {
+      lcNameIndex.insert({entry.lowerName, fileData.size()});
+      fileData.emplace_back(static_cast<int64_t>(entry.id), entry.size, entry.lowerName,
+                            entry.crc);
+    }
+    isOpen = true;
     return;
   }
 
-  if (mz_zip_open(zipHandle, streamHandle, MZ_OPEN_MODE_READ) != MZ_OK) {
-    spdlog::error("minizip: Error opening: {}", archiveName);
+  auto reader = OpenReader();
+  if (!reader) {
     return;
   }
+  isOpen = true;
+
+  void* zipHandle = reader->zipHandle;
+  bool complete = true;
 
   // We need to map file positions to speed up opening later
   for (int ret = mz_zip_goto_first_entry(zipHandle); ret == MZ_OK;
@@ -33,6 +46,7 @@ CZipArchive::CZipArchive(const std::string& archiveName)
 
     if (mz_zip_entry_get_info(zipHandle, &fileInfo) != MZ_OK) {
       spdlog::error("minizip: Failed to get entries from archive: {}", archiveName);
+      complete = false;
       break;
     }
 
@@ -53,19 +67,66 @@ CZipArchive::CZipArchive(const std::string& archiveName)
     fileData.emplace_back(mz_zip_get_entry(zipHandle), fileInfo->uncompressed_size, fLowerName,
                           fileInfo->crc);
     lcNameIndex.insert({fLowerName, fileData.size() - 1});
+    cached.push_back({static_cast<std::uint64_t>(fileData.back().pos), fileData.back().size,
+                      fileData.back().crc, 0644, fLowerName, fLowerName});
+  }
+
+  ReleaseReader(std::move(reader));
+  if (complete) {
+    CArchiveIndexCache::Save(archiveName, CArchiveIndexCache::Type::Zip, cached);
   }
 }
 
-CZipArchive::~CZipArchive() {
+CZipArchive::~CZipArchive() = default;
+
+CZipArchive::Reader::~Reader() {
   if (zipHandle != nullptr) {
     mz_zip_close(zipHandle);
+    mz_zip_delete(&zipHandle);
   }
   if (streamHandle != nullptr) {
     mz_stream_close(streamHandle);
+    mz_stream_os_delete(&streamHandle);
+  }
+}
+
+std::unique_ptr<CZipArchive::Reader> CZipArchive::OpenReader() const {
+  auto reader = std::make_unique<Reader>();
+  reader->streamHandle = mz_stream_os_create();
+  if (mz_stream_open(reader->streamHandle, GetArchiveName().c_str(), MZ_OPEN_MODE_READ) != MZ_OK) {
+    spdlog::error("minizip: Error opening: {}", GetArchiveName());
+    return nullptr;
+  }
+
+  reader->zipHandle = mz_zip_create();
+  if (mz_zip_open(reader->zipHandle, reader->streamHandle, MZ_OPEN_MODE_READ) != MZ_OK) {
+    spdlog::error("minizip: Error opening: {}", GetArchiveName());
+    return nullptr;
+  }
+
+  return reader;
+}
+
+std::unique_ptr<CZipArchive::Reader> CZipArchive::AcquireReader() {
+  {
+    const std::lock_guard<std::mutex> lock(readersMutex);
+    if (!idleReaders.empty()) {
+      auto reader = std::move(idleReaders.back());
+      idleReaders.pop_back();
+      return reader;
+    }
   }
+
+  // Opening re-reads the central directory, do it outside of the lock.
+  return OpenReader();
 }
 
-bool CZipArchive::IsOpen() const { return zipHandle != nullptr; }
+void CZipArchive::ReleaseReader(std::unique_ptr<Reader> reader) {
+  const std::lock_guard<std::mutex> lock(readersMutex);
+  idleReaders.push_back(std::move(reader));
+}
+
+bool CZipArchive::IsOpen() const { return isOpen; }
 
 std::size_t CZipArchive::NumFiles() const { return fileData.size(); }
 
@@ -89,13 +150,25 @@ std::size_t CZipArchive::GetCrc32(std::size_t fid) {
 // the zip-file, since zlib does not provide any way of reading more
 // than one file at a time
 bool CZipArchive::GetFile(std::size_t fid, std::vector<std::uint8_t>& buffer) {
+  if (!isOpen) {
+    return false;
+  }
+
+  auto reader = AcquireReader();
+  if (!reader) {
+    return false;
+  }
+  void* zipHandle = reader->zipHandle;
+
   if (mz_zip_goto_entry(zipHandle, fileData[fid].pos) != MZ_OK) {
     spdlog::debug("Failed to goto zip entry");
+    ReleaseReader(std::move(reader));
     return false;
   }
 
   if (mz_zip_entry_read_open(zipHandle, 0, nullptr) != MZ_OK) {
     spdlog::debug("Failed to goto open entry");
+    ReleaseReader(std::move(reader));
     return false;
   }
 
@@ -111,6 +184,7 @@ bool CZipArchive::GetFile(std::size_t fid, std::vector<std::uint8_t>& buffer) {
   if (mz_zip_entry_close(zipHandle) != MZ_OK) {
     ret = false;
   }
+  ReleaseReader(std::move(reader));
 
   if (!ret) {
     buffer.clear();
@@ -118,3 +192,59 @@ bool CZipArchive::GetFile(std::size_t fid, std::vector<std::uint8_t>& buffer) {
 
   return ret;
 }
+
+bool CZipArchive::GetMappedView(std::size_t fid, FileView& view) {
+  if (!isOpen) {
+    return false;
+  }
+
+  auto reader = AcquireReader();
+  if (!reader) {
+    return false;
+  }
+
+  mz_zip_file* fileInfo = nullptr;
+  const bool found = mz_zip_goto_entry(reader->zipHandle, fileData[fid].pos) == MZ_OK &&
+                     mz_zip_entry_get_info(reader->zipHandle, &fileInfo) == MZ_OK;
+  const bool stored = found && fileInfo->compression_method == MZ_COMPRESS_METHOD_STORE &&
+                (fileInfo->flag & MZ_ZIP_FLAG_ENCRYPTED) == 0 && fileInfo->disk_number == 0 &&
+                fileInfo->compressed_size == fileInfo->uncompressed_size;
+  const std::int64_t headerOffset = stored ? fileInfo->disk_offset : 0;
+  ReleaseReader(std::move(reader));
+  if (!stored) {
+    return false;
+  }
+
+  std::shared_ptr<const CMappedFile> file;
+  {
+    const std::lock_guard<std::mutex> lock(readersMutex);
+    if (!mapping) {
+      auto mapped = std::make_shared<CMappedFile>(GetArchiveName());
+      if (!mapped->IsOpen()) {
+        return false;
+      }
+      mapping = std::move(mapped);
+    }
+    file = mapping;
+  }
+
+  // The local header has its own name and extra field lengths, the data follows them.
+  constexpr std::size_t kLocalHeaderSize = 30;
+  const auto data = file->Data();
+  const auto offset = static_cast<std::size_t>(headerOffset);
+  if (headerOffset < 0 || offset + kLocalHeaderSize > data.size() || data[offset] != 'P' ||
+      data[offset + 1] != 'K' || data[offset + 2] != 3 || data[offset + 3] != 4) {
+    return false;
+  }
+
+  const std::size_t nameLength = data[offset + 26] | (data[offset + 27] << 8);
+  const std::size_t extraLength = data[offset + 28] | (data[offset + 29] << 8);
+  const std::size_t start = offset + kLocalHeaderSize + nameLength + extraLength;
+  const std::size_t size = fileData[fid].size;
+  if (start + size > data.size()) {
+    return false;
+  }
+
+  view.Assign(std::move(file), start, size);
+  return true;
+}
@@ -1,10 +1,14 @@
 /* This file is part of the Spring engine (GPL v2 or later), see LICENSE.html */
 #pragma once
 
+#include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 #include "IArchive.h"
 
+class CMappedFile;
+
 /**
  * A zip compressed, single-file archive.
  */
@@ -18,15 +22,40 @@ class CZipArchive : public IArchive {
   virtual std::size_t NumFiles() const override;
   virtual void FileInfo(std::size_t fid, std::string& name, int& size, int& mode) const override;
 
+  /**
+   * Safe to call from several threads at once, every concurrent call reads
+   * through its own zip handle.
+   */
   virtual bool GetFile(std::size_t fid, std::vector<std::uint8_t>& buffer) override;
+  /**
+   * Entries stored without compression are returned as a view into the
+   * memory-mapped archive.
+   */
+  virtual bool GetMappedView(std::size_t fid, FileView& view) override;
 
 #if 0
   virtual std::size_t GetCrc32(std::size_t fid);
 #endif
 
  protected:
-  void* streamHandle;
-  void* zipHandle;
+  // An open stream and zip handle, only ever used by one thread at a time.
+  struct Reader {
+    void* streamHandle = nullptr;
+    void* zipHandle = nullptr;
+
+    ~Reader();
+  };
+
+  // Takes an idle reader, or opens another one when all are in use.
+  std::unique_ptr<Reader> AcquireReader();
+  void ReleaseReader(std::unique_ptr<Reader> reader);
+  std::unique_ptr<Reader> OpenReader() const;
+
+  bool isOpen = false;
+  std::mutex readersMutex;
+  std::vector<std::unique_ptr<Reader>> idleReaders;
+  // The whole archive, mapped on the first GetMappedView() of a stored entry.
+  std::shared_ptr<const CMappedFile> mapping;
 
   struct FileData {
     int64_t pos;
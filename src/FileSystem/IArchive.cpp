@@ -2,6 +2,7 @@
 
 #include "IArchive.h"
 
+#include "CMappedFile.h"
 #include "../string_util.h"
 
 // #include "System/StringUtil.h"
@@ -42,3 +43,52 @@ bool IArchive::GetFileByName(const std::string& name, std::vector<std::uint8_t>&
   GetFile(fid, buffer);
   return true;
 }
+
+void IArchive::FileView::Assign(std::vector<std::uint8_t>&& data) {
+  mapping = nullptr;
+  buffer = std::move(data);
+  view = buffer;
+}
+
+void IArchive::FileView::Assign(std::shared_ptr<const CMappedFile> file, std::size_t offset,
+                                std::size_t size) {
+  buffer.clear();
+  view = file->Data().subspan(offset, size);
+  mapping = std::move(file);
+}
+
+bool IArchive::GetMappedView(std::size_t /*fid*/, FileView& /*view*/) { return false; }
+
+bool IArchive::GetFileView(std::size_t fid, FileView& view) {
+  if (!IsFileId(fid)) {
+    return false;
+  }
+  if (GetMappedView(fid, view)) {
+    return true;
+  }
+
+  std::vector<std::uint8_t> buffer;
+  if (!GetFile(fid, buffer)) {
+    return false;
+  }
+  view.Assign(std::move(buffer));
+  return true;
+}
+
+bool IArchive::GetFiles(const std::vector<std::size_t>& fids, const FileVisitor& visitor) {
+  bool result = true;
+  std::vector<std::uint8_t> buffer;
+  for (const std::size_t fid : fids) {
+    buffer.clear();
+    if (!IsFileId(fid) || !GetFile(fid, buffer)) {
+      result = false;
+      continue;
+    }
+
+    if (!visitor(fid, buffer)) {
+      return false;
+    }
+  }
+
+  return result;
+}
@@ -3,10 +3,15 @@
 #pragma once
 
 #include <cstdint>
+#include <functional>
+#include <memory>
+#include <span>
 #include <string>
 #include <vector>
 #include <unordered_map>
 
+class CMappedFile;
+
 /**
  * @brief Abstraction of different archive types
  *
@@ -20,6 +25,39 @@ class IArchive {
   explicit IArchive(const std::string& par_archive_path) : archiveFile(par_archive_path) {}
 
  public:
+  /**
+   * Receives a file from GetFiles(), data is only valid during the call.
+   * Returning false stops GetFiles().
+   */
+  using FileVisitor = std::function<bool(std::size_t fid, std::span<const std::uint8_t> data)>;
+
+  /**
+   * Read-only contents of a file, either mapped straight from disk or held
+   * in a buffer. Move only, the data stays valid while the view lives.
+   */
+  class FileView {
+   public:
+    FileView() = default;
+    FileView(FileView&&) = default;
+    FileView& operator=(FileView&&) = default;
+    FileView(const FileView&) = delete;
+    FileView& operator=(const FileView&) = delete;
+
+    void Assign(std::vector<std::uint8_t>&& data);
+    void Assign(std::shared_ptr<const CMappedFile> file, std::size_t offset, std::size_t size);
+
+    const std::uint8_t* data() const { return view.data(); }
+    std::size_t size() const { return view.size(); }
+    bool empty() const { return view.empty(); }
+    operator std::span<const std::uint8_t>() const { return view; }
+    bool IsMapped() const { return mapping != nullptr; }
+
+   private:
+    std::shared_ptr<const CMappedFile> mapping;
+    std::vector<std::uint8_t> buffer;
+    std::span<const std::uint8_t> view;
+  };
+
   virtual ~IArchive() = default;
 
   // virtual bool IsOpen() = 0;
@@ -71,6 +109,27 @@ class IArchive {
    * @see GetFile(std::size_t fid, std::vector<boost::uint8_t>& buffer)
    */
   bool GetFileByName(const std::string& name, std::vector<std::uint8_t>& buffer);
+  /**
+   * Maps a file without copying it, possible for plain files and entries
+   * stored without compression.
+   * @return false if the file can't be mapped, use GetFile() then
+   */
+  virtual bool GetMappedView(std::size_t fid, FileView& view);
+  /**
+   * Fetches the content of a file, mapped when GetMappedView() can and
+   * read into the view's own buffer otherwise.
+   * @return true if the file was found and read
+   */
+  bool GetFileView(std::size_t fid, FileView& view);
+  /**
+   * Fetches the contents of many files at once and hands them to visitor.
+   * The files come in the order that is cheapest for the archive, solid
+   * archives decompress every block only once. Files that can't be read
+   * are skipped, the visitor never sees them.
+   * @param fids file IDs in [0, NumFiles())
+   * @return false if a file couldn't be read or the visitor stopped
+   */
+  virtual bool GetFiles(const std::vector<std::size_t>& fids, const FileVisitor& visitor);
   /**
    * Fetches the name and size in bytes of a file by its ID.
    */
@@ -3,14 +3,27 @@
 #include <IL/il.h>
 #include <IL/ilu.h>
 
+#include "FileSystem/CMappedFile.h"
+
+#include <cmath>
 #include <cstddef>
+#include <cstring>
 #include <vector>
 #include <string>
+#include <utility>
 #include <filesystem>
 
 #include <iostream>
 #include <algorithm>
 
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define IMAGE_USE_SSE2 1
+#endif
+
+#include "color_tables.h"
+#include "parallel.h"
+
 #include "spdlog/spdlog.h"
 
 struct Imagelib {
@@ -41,16 +54,24 @@ int next_power_of_two(int n) {
 
 // -------------------------------- Image ---------------------------------
 
+std::recursive_mutex& Image::devil_mutex() {
+  // Never destroyed, images in other statics may still need it at exit.
+  static auto* mutex = new std::recursive_mutex;
+  return *mutex;
+}
+
 Image::~Image() {
   if (ilid_ == 0) {
     return;
   }
 
+  const std::lock_guard<std::recursive_mutex> lock(devil_mutex());
   ilDeleteImage(ilid_);
 }
 
 // Clone
 std::shared_ptr<Image> Image::clone() const {
+  const std::lock_guard<std::recursive_mutex> lock(devil_mutex());
   auto clone = std::make_shared<Image>();
 
   if (has_error()) {
@@ -64,40 +85,42 @@ std::shared_ptr<Image> Image::clone() const {
   }
 
   if (ilCopyImage(ilid_) != IL_TRUE) {
+    clone->has_error_ = true;
+    clone->error_ = iluErrorString(ilGetError());
     return clone;
   }
 
+  clone->image_infos_();
+
   clone->path_ = path_;
   clone->name_ = name_;
+  clone->owidth_ = owidth_;
+  clone->oheight_ = oheight_;
+  clone->is_team_color_ = is_team_color_;
 
   return clone;
 }
 
-bool Image::load(const std::vector<std::uint8_t>& par_buffer) {
+bool Image::load(std::span<const std::uint8_t> par_buffer) {
   return load_from_memory_(par_buffer);
 }
 
 bool Image::load(const std::string& par_file) {
-  FILE* fp = fopen(par_file.c_str(), "rb");
-  if (fp == nullptr) {
+  // DevIL copies the pixels out, the mapping only has to live through the decode.
+  const CMappedFile file(par_file);
+  if (!file.IsOpen()) {
     has_error_ = true;
     error_ = "Failed to open file '" + par_file + "'";
     return false;
   }
 
-  fseek(fp, 0, SEEK_END);
-  int const len = ftell(fp);
-  fseek(fp, 0, SEEK_SET);
-  auto buf = std::vector<std::uint8_t>(len);
-  fread(buf.data(), len, 1, fp);
-  fclose(fp);
-
   path_ = par_file;
 
-  return load_from_memory_(buf);
+  return load_from_memory_(file.Data());
 }
 
 bool Image::create(int par_width, int par_height, int par_channels) {
+  const std::lock_guard<std::recursive_mutex> lock(devil_mutex());
   ilGenImages(1, &ilid_);
   ilBindImage(ilid_);
   ilClearColor(0.0F, 0.0F, 0.0F, 1.0F);
@@ -125,19 +148,21 @@ bool Image::create(int par_width, int par_height, float par_red, float par_green
   return clear_color(par_red, par_green, par_blue, 1.0F);
 }
 
-bool Image::save(const std::string& par_file) {
+bool Image::save(const std::string& par_file) { return save(par_file, dxt::Quality::Normal); }
+
+bool Image::save(const std::string& par_file, dxt::Quality par_quality) {
   if (has_error()) {
     return false;
   }
 
-  ilBindImage(ilid_);
-  ilEnable(IL_FILE_OVERWRITE);
-
   if (std::filesystem::path(par_file).extension() == ".dds") {
-    ilSetInteger(IL_DXTC_FORMAT, IL_DXT5);
-    ilEnable(IL_NVIDIA_COMPRESS);
+    return save_dds_(par_file, par_quality);
   }
 
+  const std::lock_guard<std::recursive_mutex> lock(devil_mutex());
+  ilBindImage(ilid_);
+  ilEnable(IL_FILE_OVERWRITE);
+
   if (ilSaveImage(static_cast<const ILstring>(par_file.c_str())) != IL_TRUE) {
     error_ = iluErrorString(ilGetError());
     has_error_ = true;
@@ -146,8 +171,65 @@ bool Image::save(const std::string& par_file) {
   return true;
 }
 
+bool Image::save_dds_(const std::string& par_file, dxt::Quality par_quality) {
+  // Only held for DevIL, the mipmaps and the compression don't need it.
+  std::unique_lock<std::recursive_mutex> lock(devil_mutex());
+  ilBindImage(ilid_);
+
+  // The compressor wants 8 bit RGB(A), convert everything else on a copy.
+  const int format = ilGetInteger(IL_IMAGE_FORMAT);
+  if ((format != IL_RGB && format != IL_RGBA) || ilGetInteger(IL_IMAGE_TYPE) != IL_UNSIGNED_BYTE) {
+    auto converted = clone();
+    if (converted->has_error()) {
+      error_ = converted->error();
+      has_error_ = true;
+      return false;
+    }
+
+    ilBindImage(converted->id());
+    if (ilConvertImage(has_alpha() ? IL_RGBA : IL_RGB, IL_UNSIGNED_BYTE) != IL_TRUE) {
+      error_ = iluErrorString(ilGetError());
+      has_error_ = true;
+      return false;
+    }
+    converted->image_infos_();
+    lock.unlock();
+
+    return converted->save_dds_(par_file, par_quality);
+  }
+  lock.unlock();
+
+  // DDS files start with the top row, DevIL keeps lower left images bottom up.
+  const bool bottom_up = origin() == ImageOrigin::LowerLeft;
+  const auto level_view = [bottom_up, this](const std::uint8_t* par_data, int par_width,
+                                            int par_height) {
+    const std::ptrdiff_t pitch = static_cast<std::ptrdiff_t>(par_width) * bpp_;
+    if (bottom_up) {
+      return dxt::Level{par_width, par_height, bpp_, par_data + (par_height - 1) * pitch, -pitch};
+    }
+    return dxt::Level{par_width, par_height, bpp_, par_data, pitch};
+  };
+
+  const auto mipmap_levels = mipmaps(MipFilter::Kaiser);
+
+  std::vector<dxt::Level> levels{level_view(data(), width_, height_)};
+  for (const auto& mipmap : mipmap_levels) {
+    levels.push_back(level_view(mipmap.data.data(), mipmap.width, mipmap.height));
+  }
+
+  const auto dxt_format = has_alpha() ? dxt::Format::BC3 : dxt::Format::BC1;
+  if (!dxt::save_dds(par_file, levels, dxt_format, par_quality)) {
+    error_ = "Failed to write '" + par_file + "'";
+    has_error_ = true;
+    return false;
+  }
+
+  return true;
+}
+
 // trunk-ignore(clang-tidy/readability-make-member-function-const)
 std::uint8_t* Image::data() {
+  const std::lock_guard<std::recursive_mutex> lock(devil_mutex());
   if (has_error()) {
     return nullptr;
   }
@@ -157,6 +239,7 @@ std::uint8_t* Image::data() {
 }
 
 bool Image::clear_color(float pRed, float pGreen, float pBlue, float pAlpha) {
+  const std::lock_guard<std::recursive_mutex> lock(devil_mutex());
   if (has_error()) {
     return false;
   }
@@ -175,6 +258,7 @@ bool Image::clear_color(float pRed, float pGreen, float pBlue, float pAlpha) {
 Add/Remove alpha channel
 */
 bool Image::add_alpha() {
+  const std::lock_guard<std::recursive_mutex> lock(devil_mutex());
   if (has_error() or has_alpha()) {
     return false;
   }
@@ -192,12 +276,15 @@ bool Image::add_alpha() {
 }
 
 bool Image::threedo_to_s3o() {
+  const std::lock_guard<std::recursive_mutex> lock(devil_mutex());
   if (has_error()) {
     return false;
   }
 
   if (bpp_ < 4) {
-    add_opaque_alpha();
+    if (!add_opaque_alpha()) {
+      return false;
+    }
 
     ilBindImage(ilid_);
 
@@ -246,7 +333,8 @@ bool Image::threedo_to_s3o() {
   return true;
 }
 
-bool Image::to_power_of_two() {
+bool Image::to_power_of_two(EdgeMode par_mode) {
+  const std::lock_guard<std::recursive_mutex> lock(devil_mutex());
   if (has_error()) {
     return false;
   }
@@ -254,86 +342,157 @@ bool Image::to_power_of_two() {
   ilBindImage(ilid_);
 
   owidth_ = width_;
-  if (!is_power_of_two(owidth_)) {
-    width_ = next_power_of_two(owidth_);
-    // spdlog::debug("Enlarging '{}' cause the width '{}' is not power of two '{}'.", name_,
-    // owidth_,
-    //               width_);
+  oheight_ = height_;
+
+  if (is_power_of_two(width_) && is_power_of_two(height_)) {
+    return true;
   }
 
-  oheight_ = height_;
-  if (!is_power_of_two(oheight_)) {
-    height_ = next_power_of_two(oheight_);
-    // spdlog::debug("Enlarging '{}' cause the height '{}' is not power of two '{}'.", name_,
-    // oheight_,
-    //               height_);
+  if (ilConvertImage(has_alpha() ? IL_RGBA : IL_RGB, IL_UNSIGNED_BYTE) != IL_TRUE) {
+    has_error_ = true;
+    error_ = iluErrorString(ilGetError());
+    return false;
   }
 
-  if (width_ != owidth_ || height_ != oheight_) {
-    if (ilConvertImage(has_alpha() ? IL_RGBA : IL_RGB, IL_UNSIGNED_BYTE) != IL_TRUE) {
-      has_error_ = true;
-      error_ = iluErrorString(ilGetError());
-      return false;
-    }
+  ilClearColor(0.0F, 0.0F, 0.0F, 0.0F);
+  iluImageParameter(ILU_PLACEMENT, ILU_UPPER_LEFT);
+  if (iluEnlargeCanvas(next_power_of_two(owidth_), next_power_of_two(oheight_), 1) != IL_TRUE) {
+    has_error_ = true;
+    error_ = iluErrorString(ilGetError());
+    return false;
+  }
+
+  image_infos_();
 
-    ilClearColor(0.0F, 0.0F, 0.0F, 0.0F);
-    iluImageParameter(ILU_PLACEMENT, ILU_UPPER_LEFT);
-    iluEnlargeCanvas(width_, height_, 1);
+  // ILU_UPPER_LEFT keeps the image in the first columns, the rows it lands in depend on the
+  // origin of the image.
+  const int content_y = origin() == ImageOrigin::LowerLeft ? height_ - oheight_ : 0;
 
-    image_infos_();
+  return extend_edges(0, content_y, owidth_, oheight_, par_mode);
+}
+
+namespace {
+
+// The helpers below work on a line of "elements", an element is either a pixel (to extend a row)
+// or a whole row (to extend the image vertically).
+
+// Writes the mirror of the count elements before start to [start, start + count).
+void reflect_forward(std::uint8_t* par_data, std::size_t par_elem, int par_start, int par_count) {
+  for (int i = 0; i < par_count; i++) {
+    std::memcpy(par_data + (par_start + i) * par_elem, par_data + (par_start - 1 - i) * par_elem,
+                par_elem);
   }
+}
 
-  auto* data_ptr = ilGetData();
+// Writes the mirror of the count elements starting at end to [end - count, end).
+void reflect_backward(std::uint8_t* par_data, std::size_t par_elem, int par_end, int par_count) {
+  for (int i = 0; i < par_count; i++) {
+    std::memcpy(par_data + (par_end - 1 - i) * par_elem, par_data + (par_end + i) * par_elem,
+                par_elem);
+  }
+}
 
-  std::size_t num_pixels = static_cast<std::size_t>(width_) * height_;
+// [par_base, par_start) holds one period, repeat it until par_end, doubling the copied block on
+// every step.
+void repeat_forward(std::uint8_t* par_data, std::size_t par_elem, int par_base, int par_start,
+                    int par_end) {
+  int pos = par_start;
+  while (pos < par_end) {
+    const int count = std::min(pos - par_base, par_end - pos);
+    std::memcpy(par_data + pos * par_elem, par_data + par_base * par_elem, count * par_elem);
+    pos += count;
+  }
+}
 
-  // Copy to bottom
-  if (height_ > oheight_) {
-    for (int ih = 0; ih < height_ - oheight_; ih++) {
-      for (int iw = 0; iw <= owidth_; iw++) {
-        const int src = (height_ - oheight_ - ih + height_ - oheight_) * width_ + iw;
-        const int dst = ih * width_ + iw;
+// [par_start, par_top) holds one period, repeat it down to element 0.
+void repeat_backward(std::uint8_t* par_data, std::size_t par_elem, int par_start, int par_top) {
+  int pos = par_start;
+  while (pos > 0) {
+    const int count = std::min(par_top - pos, pos);
+    std::memcpy(par_data + (pos - count) * par_elem, par_data + (par_top - count) * par_elem,
+                count * par_elem);
+    pos -= count;
+  }
+}
 
-        if (dst > num_pixels) {
-          spdlog::warn("'{}' - 'row' can't write to destination: '{}', number of pixels is '{}'",
-                       name_, dst, num_pixels);
-          continue;
-        }
+// Extends the elements [par_first, par_first + par_count) over a line of par_total elements.
+void extend_line(std::uint8_t* par_data, std::size_t par_elem, int par_first, int par_count,
+                 int par_total, EdgeMode par_mode) {
+  const int last = par_first + par_count;
+
+  if (last < par_total) {
+    switch (par_mode) {
+      case EdgeMode::Clamp:
+        repeat_forward(par_data, par_elem, last - 1, last, par_total);
+        break;
+      case EdgeMode::Wrap:
+        repeat_forward(par_data, par_elem, par_first, last, par_total);
+        break;
+      case EdgeMode::Mirror: {
+        const int reflected = std::min(par_count, par_total - last);
+        reflect_forward(par_data, par_elem, last, reflected);
+        repeat_forward(par_data, par_elem, par_first, last + reflected, par_total);
+        break;
+      }
+    }
+  }
 
-        // trunk-ignore(clang-tidy/cppcoreguidelines-pro-bounds-pointer-arithmetic)
-        std::memcpy(data_ptr + static_cast<ptrdiff_t>(dst * bpp_),
-                    data_ptr + static_cast<ptrdiff_t>(src * bpp_), bpp_);
+  if (par_first > 0) {
+    switch (par_mode) {
+      case EdgeMode::Clamp:
+        repeat_backward(par_data, par_elem, par_first, par_first + 1);
+        break;
+      case EdgeMode::Wrap:
+        repeat_backward(par_data, par_elem, par_first, last);
+        break;
+      case EdgeMode::Mirror: {
+        const int reflected = std::min(par_count, par_first);
+        reflect_backward(par_data, par_elem, par_first, reflected);
+        repeat_backward(par_data, par_elem, par_first - reflected, last);
+        break;
       }
     }
   }
+}
 
-  // Copy to the right side
-  if (width_ > owidth_) {
-    for (int ih = height_ - 1; ih >= 0; ih--) {
-      for (int iw = 0; iw < (width_ - owidth_); iw++) {
-        const int src = ih * width_ + owidth_ - 1 - iw;
-        const int dst = ih * width_ + owidth_ + iw;
+}  // namespace
 
-        if (dst > num_pixels) {
-          spdlog::warn("'{}' - 'column' can't write to destination: '{}', number of pixels is '{}'",
-                       name_, dst, num_pixels);
-          continue;
-        }
+bool Image::extend_edges(int par_x, int par_y, int par_width, int par_height,
+                         EdgeMode par_mode) {
+  if (has_error()) {
+    return false;
+  }
 
-        // trunk-ignore(clang-tidy/cppcoreguidelines-pro-bounds-pointer-arithmetic)
-        std::memcpy(data_ptr + static_cast<ptrdiff_t>(dst * bpp_),
-                    data_ptr + static_cast<ptrdiff_t>(src * bpp_), bpp_);
-      }
+  if (par_width <= 0 || par_height <= 0 || par_x < 0 || par_y < 0 ||
+      par_x + par_width > width_ || par_y + par_height > height_) {
+    has_error_ = true;
+    error_ = "extend_edges, rect is outside of the image";
+    return false;
+  }
+
+  if (par_width == width_ && par_height == height_) {
+    return true;
+  }
+
+  std::uint8_t* data_ptr = data();
+  const std::size_t row_size = static_cast<std::size_t>(width_) * bpp_;
+
+  // Extend the rows of the rect horizontally first, then copy whole rows vertically.
+  if (par_width < width_) {
+    for (int row = par_y; row < par_y + par_height; row++) {
+      extend_line(data_ptr + row * row_size, bpp_, par_x, par_width, width_, par_mode);
     }
   }
 
-  // Update the image information
-  image_infos_();
+  if (par_height < height_) {
+    extend_line(data_ptr, row_size, par_y, par_height, height_, par_mode);
+  }
 
   return true;
 }
 
 bool Image::add_opaque_alpha() {
+  const std::lock_guard<std::recursive_mutex> lock(devil_mutex());
   if (has_error()) {
     return false;
   }
@@ -350,7 +509,261 @@ bool Image::add_opaque_alpha() {
   return true;
 }
 
+namespace {
+
+// The source samples (and their weights) every destination sample along one axis is made of.
+struct FilterKernel {
+  int taps;
+  std::vector<int> index;
+  std::vector<float> weight;
+};
+
+float bessel_i0(float par_x) {
+  float sum = 1.0F;
+  float term = 1.0F;
+  for (int k = 1; k < 20; k++) {
+    term *= (par_x / (2.0F * k)) * (par_x / (2.0F * k));
+    sum += term;
+  }
+  return sum;
+}
+
+float kaiser_sinc(float par_x, float par_radius) {
+  constexpr float kAlpha = 4.0F;
+  constexpr float kPi = 3.14159265358979F;
+
+  const float window = par_x / par_radius;
+  if (std::fabs(window) >= 1.0F) {
+    return 0.0F;
+  }
+
+  const float sinc = par_x == 0.0F ? 1.0F : std::sin(kPi * par_x) / (kPi * par_x);
+  return sinc * bessel_i0(kAlpha * std::sqrt(1.0F - window * window)) / bessel_i0(kAlpha);
+}
+
+FilterKernel make_kernel(int par_src_size, int par_dst_size, MipFilter par_filter) {
+  // Kaiser radius in destination pixels.
+  constexpr int kRadius = 3;
+
+  // On odd sizes a box covers 2 + 1 / dst source samples, parts of 3 of them at most, and the
+  // Kaiser window kRadius * scale source samples to either side of the centre.
+  const bool even = par_src_size == 2 * par_dst_size;
+  const float scale = static_cast<float>(par_src_size) / static_cast<float>(par_dst_size);
+  FilterKernel kernel;
+  if (par_filter == MipFilter::Box) {
+    kernel.taps = even ? 2 : 3;
+  } else {
+    kernel.taps = even ? 4 * kRadius : static_cast<int>(2.0F * kRadius * scale) + 1;
+  }
+  kernel.index.resize(static_cast<std::size_t>(par_dst_size) * kernel.taps);
+  kernel.weight.resize(kernel.index.size());
+
+  for (int d = 0; d < par_dst_size; d++) {
+    // Destination sample d covers the source range [d * scale, (d + 1) * scale), source sample i
+    // sits at i + 0.5.
+    const float begin = d * scale;
+    const float end = begin + scale;
+    const float centre = begin + scale / 2.0F;
+    int first = static_cast<int>(std::ceil(centre - 0.5F - kRadius * scale));
+    if (par_filter == MipFilter::Box) {
+      first = even ? 2 * d : static_cast<int>(begin);
+    }
+    float sum = 0.0F;
+
+    for (int t = 0; t < kernel.taps; t++) {
+      const int src = first + t;
+      float weight = 0.5F;
+      if (par_filter == MipFilter::Kaiser) {
+        weight = kaiser_sinc((static_cast<float>(src) + 0.5F - centre) / scale, kRadius);
+      } else if (!even) {
+        // Weighted by how much of the source sample lies inside the box.
+        weight = std::max(0.0F, std::min(end, src + 1.0F) - std::max(begin, src + 0.0F));
+      }
+
+      kernel.index[d * kernel.taps + t] = std::clamp(src, 0, par_src_size - 1);
+      kernel.weight[d * kernel.taps + t] = weight;
+      sum += weight;
+    }
+
+    for (int t = 0; t < kernel.taps; t++) {
+      kernel.weight[d * kernel.taps + t] /= sum;
+    }
+  }
+
+  return kernel;
+}
+
+// Levels below this many floats are filtered on the calling thread, spawning the workers costs
+// more than the work itself.
+constexpr std::size_t kParallelMinFloats = 64 * 1024;
+
+// Calls par_fn(y) for all par_rows rows of par_row_size floats, in parallel for large levels.
+template <typename Fn>
+void for_each_row(std::size_t par_rows, std::size_t par_row_size, Fn&& par_fn) {
+  if (par_rows * par_row_size < kParallelMinFloats) {
+    for (std::size_t y = 0; y < par_rows; y++) {
+      par_fn(y);
+    }
+    return;
+  }
+
+  ups::parallel_for(par_rows, std::forward<Fn>(par_fn));
+}
+
+// par_dst += par_weight * par_src
+void accumulate(float* par_dst, const float* par_src, float par_weight, std::size_t par_count) {
+  std::size_t i = 0;
+#ifdef IMAGE_USE_SSE2
+  const __m128 weight = _mm_set1_ps(par_weight);
+  for (; i + 4 <= par_count; i += 4) {
+    const __m128 value = _mm_mul_ps(_mm_loadu_ps(par_src + i), weight);
+    _mm_storeu_ps(par_dst + i, _mm_add_ps(_mm_loadu_ps(par_dst + i), value));
+  }
+#endif
+  for (; i < par_count; i++) {
+    par_dst[i] += par_src[i] * par_weight;
+  }
+}
+
+// Filters every row of par_src (par_width pixels) down to par_kernel's destination width.
+void filter_rows(const std::vector<float>& par_src, int par_width, int par_height,
+                 int par_channels, const FilterKernel& par_kernel, int par_dst_width,
+                 std::vector<float>& par_dst) {
+  par_dst.assign(static_cast<std::size_t>(par_dst_width) * par_height * par_channels, 0.0F);
+
+  const std::size_t row_size = static_cast<std::size_t>(par_width) * par_channels;
+  for_each_row(par_height, row_size, [&](std::size_t par_y) {
+    const float* src = par_src.data() + par_y * par_width * par_channels;
+    float* dst = par_dst.data() + par_y * par_dst_width * par_channels;
+
+    for (int x = 0; x < par_dst_width; x++) {
+      float* pixel = dst + x * par_channels;
+      for (int t = 0; t < par_kernel.taps; t++) {
+        accumulate(pixel, src + par_kernel.index[x * par_kernel.taps + t] * par_channels,
+                   par_kernel.weight[x * par_kernel.taps + t], par_channels);
+      }
+    }
+  });
+}
+
+}  // namespace
+
+std::vector<MipLevel> Image::mipmaps(MipFilter par_filter, bool par_srgb) {
+  std::vector<MipLevel> result;
+  if (has_error()) {
+    return result;
+  }
+
+  const std::uint8_t* pixels = nullptr;
+  {
+    const std::lock_guard<std::recursive_mutex> lock(devil_mutex());
+    ilBindImage(ilid_);
+    if (ilGetInteger(IL_IMAGE_TYPE) != IL_UNSIGNED_BYTE) {
+      spdlog::error("mipmaps, '{}' is not an 8 bit image", name_);
+      return result;
+    }
+    pixels = ilGetData();
+  }
+
+  const int channels = bpp_;
+  const int alpha = (channels == 2 || channels == 4) ? channels - 1 : -1;
+  const ups::ColorTables& tables = ups::color_tables(par_srgb);
+  const ups::ColorTables& alpha_tables = ups::color_tables(false);
+
+  // The whole chain gets filtered in linear float, each level is made from the one above.
+  int width = width_;
+  int height = height_;
+  const std::size_t row_size = static_cast<std::size_t>(width) * channels;
+  std::vector<float> level(row_size * height);
+
+  for_each_row(height, row_size, [&](std::size_t par_y) {
+    for (std::size_t i = par_y * row_size; i < (par_y + 1) * row_size; i++) {
+      const bool is_alpha = static_cast<int>(i % channels) == alpha;
+      level[i] = (is_alpha ? alpha_tables : tables).to_linear[pixels[i]];
+    }
+  });
+
+  std::vector<float> rows;
+  std::vector<float> next;
+  while (width > 1 || height > 1) {
+    const int dst_width = std::max(1, width / 2);
+    const int dst_height = std::max(1, height / 2);
+    const FilterKernel kernel_x = make_kernel(width, dst_width, par_filter);
+    const FilterKernel kernel_y = make_kernel(height, dst_height, par_filter);
+
+    filter_rows(level, width, height, channels, kernel_x, dst_width, rows);
+
+    const std::size_t dst_row_size = static_cast<std::size_t>(dst_width) * channels;
+    next.assign(dst_row_size * dst_height, 0.0F);
+
+    MipLevel mipmap{dst_width, dst_height, std::vector<std::uint8_t>(next.size())};
+    for_each_row(dst_height, dst_row_size * kernel_y.taps, [&](std::size_t par_y) {
+      float* dst = next.data() + par_y * dst_row_size;
+      for (int t = 0; t < kernel_y.taps; t++) {
+        accumulate(dst, rows.data() + kernel_y.index[par_y * kernel_y.taps + t] * dst_row_size,
+                   kernel_y.weight[par_y * kernel_y.taps + t], dst_row_size);
+      }
+
+      // Negative lobes of the Kaiser filter can overshoot.
+      std::uint8_t* out = mipmap.data.data() + par_y * dst_row_size;
+      for (std::size_t i = 0; i < dst_row_size; i++) {
+        dst[i] = std::clamp(dst[i], 0.0F, 1.0F);
+        const bool is_alpha = static_cast<int>(i % channels) == alpha;
+        out[i] = (is_alpha ? alpha_tables : tables)
+                     .from_linear[static_cast<int>(dst[i] * (ups::kLinearTableSize - 1) + 0.5F)];
+      }
+    });
+
+    result.push_back(std::move(mipmap));
+    level.swap(next);
+    width = dst_width;
+    height = dst_height;
+  }
+
+  return result;
+}
+
+ImageOrigin Image::origin() const {
+  const std::lock_guard<std::recursive_mutex> lock(devil_mutex());
+  if (has_error()) {
+    return ImageOrigin::LowerLeft;
+  }
+
+  ilBindImage(ilid_);
+  return ilGetInteger(IL_IMAGE_ORIGIN) == IL_ORIGIN_UPPER_LEFT ? ImageOrigin::UpperLeft
+                                                                : ImageOrigin::LowerLeft;
+}
+
+void Image::origin(ImageOrigin par_origin) {
+  const std::lock_guard<std::recursive_mutex> lock(devil_mutex());
+  if (has_error()) {
+    return;
+  }
+
+  ilBindImage(ilid_);
+  ilRegisterOrigin(par_origin == ImageOrigin::UpperLeft ? IL_ORIGIN_UPPER_LEFT
+                                                        : IL_ORIGIN_LOWER_LEFT);
+}
+
+bool Image::to_origin(ImageOrigin par_origin) {
+  if (has_error()) {
+    return false;
+  }
+
+  if (origin() == par_origin) {
+    return true;
+  }
+
+  if (!flip() || has_error()) {
+    return false;
+  }
+
+  origin(par_origin);
+  return true;
+}
+
 bool Image::mirror() {
+  const std::lock_guard<std::recursive_mutex> lock(devil_mutex());
   if (has_error()) {
     return false;
   }
@@ -365,6 +778,7 @@ bool Image::mirror() {
 }
 
 bool Image::flip() {
+  const std::lock_guard<std::recursive_mutex> lock(devil_mutex());
   if (has_error()) {
     return false;
   }
@@ -384,6 +798,7 @@ it is just a way to copy certain parts of an image.
 */
 bool Image::blit(const std::shared_ptr<Image> par_src, int par_dx, int par_dy, int par_dz,
                  int par_sx, int par_sy, int par_sz, int par_width, int par_height, int par_depth) {
+  const std::lock_guard<std::recursive_mutex> lock(devil_mutex());
   if (has_error() or par_src->has_error()) {
     error_ = "blit, either the destination or the source has an error";
     return false;
@@ -411,7 +826,8 @@ bool Image::blit(const std::shared_ptr<Image> par_src, int par_dx, int par_dy, i
   return true;
 }
 
-bool Image::load_from_memory_(const std::vector<std::uint8_t>& par_buffer) {
+bool Image::load_from_memory_(std::span<const std::uint8_t> par_buffer) {
+  const std::lock_guard<std::recursive_mutex> lock(devil_mutex());
   if (ilid_ != 0) {
     ilDeleteImage(ilid_);
   }
@@ -448,6 +864,7 @@ bool Image::load_from_memory_(const std::vector<std::uint8_t>& par_buffer) {
 }
 
 void Image::image_infos_() {
+  const std::lock_guard<std::recursive_mutex> lock(devil_mutex());
   if (has_error()) {
     return;
   }
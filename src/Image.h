@@ -2,9 +2,47 @@
 
 #include <cstdint>
 #include <memory>
+#include <mutex>
+#include <span>
 #include <vector>
 #include <string>
 
+#include "dxt_compressor.h"
+
+/**
+ * How padding around an image is filled when it gets enlarged.
+ */
+enum class EdgeMode {
+  Clamp,   // repeat the outermost row/column
+  Mirror,  // reflect the image at its edges
+  Wrap     // tile the image
+};
+
+/**
+ * Which picture row the first row of Image::data() holds.
+ */
+enum class ImageOrigin {
+  LowerLeft,  // bottom row first, what OpenGL expects
+  UpperLeft   // top row first, how DDS and most other files store it
+};
+
+/**
+ * Downsampling filter for mipmap generation.
+ */
+enum class MipFilter {
+  Box,    // average of 2x2 pixels
+  Kaiser  // windowed sinc, sharper but slower
+};
+
+/**
+ * One level of a mipmap chain, pixels in the same layout as the source image.
+ */
+struct MipLevel {
+  int width;
+  int height;
+  std::vector<std::uint8_t> data;
+};
+
 class Image {
  public:
   // Constructors
@@ -25,7 +63,13 @@ class Image {
 
   virtual ~Image();
 
-  bool load(const std::vector<std::uint8_t>& par_buffer);
+  /**
+   * DevIL works on a global bound image, every Image method holds this while it calls DevIL.
+   * Take it as well when calling DevIL directly.
+   */
+  static std::recursive_mutex& devil_mutex();
+
+  bool load(std::span<const std::uint8_t> par_buffer);
   bool load(const std::string& par_file);
 
   // For Swig.
@@ -39,6 +83,12 @@ class Image {
 
   bool save(const std::string& par_file);
 
+  /**
+   * As above, .dds files get written by the builtin DXT compressor with a full mipmap chain,
+   * DXT5 for images with alpha, DXT1 otherwise.
+   */
+  bool save(const std::string& par_file, dxt::Quality par_quality);
+
   // Copy
   Image(const Image& rhs) = delete;
   Image& operator=(const Image& rhs) = delete;
@@ -80,7 +130,32 @@ class Image {
   bool threedo_to_s3o();
   bool add_opaque_alpha();
 
-  bool to_power_of_two();
+  bool to_power_of_two(EdgeMode par_mode = EdgeMode::Clamp);
+
+  /**
+   * Fills everything outside of the given rect with the content of the rect,
+   * the rect is given in memory order (row 0 is the first row of data()).
+   */
+  bool extend_edges(int par_x, int par_y, int par_width, int par_height, EdgeMode par_mode);
+
+  /**
+   * Generates the mipmap levels below this image down to 1x1, the image itself is not part of
+   * the result. With par_srgb the color channels get filtered in linear space, alpha always is.
+   * Only works on 8 bit images.
+   */
+  std::vector<MipLevel> mipmaps(MipFilter par_filter = MipFilter::Box, bool par_srgb = true);
+
+  /**
+   * The origin is tracked instead of flipping on load, consumers flip (or read the rows in
+   * reverse) when they need the other one. The setter only relabels the pixels.
+   */
+  ImageOrigin origin() const;
+  void origin(ImageOrigin par_origin);
+
+  /**
+   * Flips the image if it doesn't have par_origin yet.
+   */
+  bool to_origin(ImageOrigin par_origin);
 
   bool mirror();
   bool flip();
@@ -111,7 +186,8 @@ class Image {
 
   bool is_team_color_;
 
-  bool load_from_memory_(const std::vector<std::uint8_t>& par_buffer);
+  bool load_from_memory_(std::span<const std::uint8_t> par_buffer);
+  bool save_dds_(const std::string& par_file, dxt::Quality par_quality);
   void image_infos_();
 };
 
@@ -25,6 +25,8 @@
 
 #include "MeshIterators.h"
 
+#include "FileIO/TAPalette.h"
+
 #include "spdlog/spdlog.h"
 
 uint Vector3ToRGB(Vector3 v) {
@@ -32,6 +34,25 @@ uint Vector3ToRGB(Vector3 v) {
          (static_cast<uint>(v.z * 255.0F) << 0);
 }
 
+// Colour polygons get mapped onto a single texture holding the whole TA palette.
+static const char* const kPaletteTextureName = "ta_palette";
+
+// Palette entry of a colour polygon, poly->color is quantised (see CTAPalette::GetColor).
+static int PaletteIndex(const Poly* par_poly) {
+  if (par_poly->taColor >= 0 && par_poly->taColor < 256) {
+    return par_poly->taColor;
+  }
+  return GetTAPalette().FindIndex(par_poly->color);
+}
+
+static std::shared_ptr<Texture> CreatePaletteTexture(std::uint32_t par_margin = 0) {
+  auto image = GetTAPalette().CreateImage(CTAPalette::BlockSize(static_cast<int>(par_margin)));
+  if (image->has_error()) {
+    return nullptr;
+  }
+  return std::make_shared<Texture>(image, kPaletteTextureName);
+}
+
 // ------------------------------------------------------------------------------------------------
 // Model
 // ------------------------------------------------------------------------------------------------
@@ -105,6 +126,48 @@ Model* Model::Load(const std::string& _fn, bool /*Optimize*/, IProgressCtl& prog
   return nullptr;
 }
 
+Model* Model::load_from_memory(std::span<const std::uint8_t> par_buffer,
+                              const std::string& par_name, std::string* par_error) {
+  const auto set_error = [par_error](const std::string& par_message) {
+    if (par_error != nullptr) {
+      *par_error = par_message;
+    }
+  };
+
+  const auto ext = to_lower(std::filesystem::path(par_name).extension().string());
+  if (ext != ".3do" && ext != ".s3o") {
+    set_error("unsupported extension '" + ext + "'");
+    return nullptr;
+  }
+
+  FILE* f = OpenMemoryFile(par_buffer.data(), par_buffer.size());
+  if (f == nullptr) {
+    set_error(par_buffer.empty() ? "empty file" : "failed to open the buffer");
+    return nullptr;
+  }
+
+  auto* mdl = new Model;
+  bool r = false;
+  try {
+    r = ext == ".3do" ? mdl->Load3DO(f) : mdl->LoadS3O(f, par_name.c_str(), false);
+    if (!r) {
+      set_error("not a valid model");
+    }
+  } catch (const std::exception& err) {
+    // Corrupt counts end up in vector::resize, length_error and bad_alloc included.
+    set_error(err.what());
+  }
+  fclose(f);
+
+  if (!r) {
+    delete mdl;
+    return nullptr;
+  }
+
+  mdl->file_ = par_name;
+  return mdl;
+}
+
 bool Model::Save(Model* mdl, const std::string& _fn, IProgressCtl& progctl) {
   bool r = false;
   const char* fn = _fn.c_str();
@@ -485,24 +548,17 @@ bool Model::ConvertToS3O(std::string textureName, int texw, int texh) {
         }
         textures.insert({poly->texname, poly->texture});
 
-      } else if (poly->color.x != 0.0F) {  // create a new color texture
-        const std::string color_name(SPrintf("color_%d", Vector3ToRGB(poly->color)));
-
-        auto ci_ti = textures.find(color_name);
-        if (ci_ti != textures.end()) {
-          poly->texture = ci_ti->second;
+      } else if (poly->color.x != 0.0F) {  // colors use the palette texture
+        if (textures.find(kPaletteTextureName) != textures.end()) {
           continue;
         }
 
-        auto color_image = std::make_shared<Image>();
-        color_image->name(color_name);
-        if (!color_image->create(1, 1, poly->color.x, poly->color.y, poly->color.z)) {
-          spdlog::error("Failed to create a color image, error was: {}", color_image->error());
+        auto palette_tex = CreatePaletteTexture();
+        if (palette_tex == nullptr) {
+          spdlog::error("Failed to create the palette texture");
           continue;
         }
-
-        auto color_tex = std::make_shared<Texture>(color_image, color_name);
-        textures.insert({color_name, color_tex});
+        textures.insert({kPaletteTextureName, palette_tex});
 
       } else {
         continue;
@@ -510,51 +566,51 @@ bool Model::ConvertToS3O(std::string textureName, int texw, int texh) {
     }
   }
 
-  TextureBinTree tree(texw, texh);
-  std::map<std::string, TextureBinTree::Node*> texToNode;
-
+  std::vector<std::string> names;
+  std::vector<std::shared_ptr<Image>> images;
   for (auto& texmap_entry : textures) {
-    auto img = texmap_entry.second->image;
+    auto& texture = texmap_entry.second;
+    if (texture->HasError()) {
+      continue;
+    }
 
     // On teamcolor we copy the red channel to green, on normal textures we add a opaque alpha.
-    if (texture_handler_->has_team_color(img->name())) {
-      if (!img->threedo_to_s3o()) {
-        spdlog::error("image->threedo_to_s3o failed, error was: {}", img->error());
-        continue;
-      }
-    } else if (!img->add_opaque_alpha()) {
-      spdlog::error("image->add_opaque_alpha failed, error was: {}", img->error());
+    const bool team_color = texture_handler_ != nullptr
+                                ? texture_handler_->has_team_color(texture->image->name())
+                                : texture->image->is_team_color();
+    auto img = texture->GetVariant(team_color ? TEXVAR_TEAMCOLOR : TEXVAR_OPAQUE);
+    if (img->has_error()) {
       continue;
     }
 
-    TextureBinTree::Node* node = tree.AddNode(img);
+    names.push_back(texmap_entry.first);
+    images.push_back(img);
+  }
 
-    if (node == nullptr) {
-      spdlog::error("Not enough texture space for all 3DO textures");
-      return false;
-    }
+  // The tree grows until everything fits, texw/texh are the smallest size to use.
+  TextureBinTree tree(texw, texh);
+  std::vector<TextureBinTree::Node*> nodes;
+  if (!tree.AddNodes(images, nodes)) {
+    spdlog::error("Not enough texture space for all 3DO textures");
+    return false;
+  }
 
-    texToNode.insert({texmap_entry.first, node});
+  std::map<std::string, TextureBinTree::Node*> texToNode;
+  for (std::size_t i = 0; i < names.size(); i++) {
+    texToNode.insert({names[i], nodes[i]});
   }
 
   auto img = tree.GetResult();
   auto ext = std::filesystem::path(textureName).extension();
 
-  if (!img->flip()) {
-    spdlog::error("Failed to flip the atlas, error was: {}", img->error());
-    return false;
-  }
+  // The tree fills the atlas top row first, relabel it instead of flipping.
+  img->origin(ImageOrigin::UpperLeft);
 
   if (!img->save(textureName)) {
     spdlog::error("Failed to save the atlas");
     return false;
   }
 
-  // if (!img->flip()) {
-  //   spdlog::error("Failed to flip the atlas, error was: {}", img->error());
-  //   return false;
-  // }
-
   auto tex1 = std::make_shared<Texture>();
   tex1->SetImage(img);
   tex1->name = std::filesystem::path(textureName).filename().string();
@@ -567,6 +623,23 @@ bool Model::ConvertToS3O(std::string textureName, int texw, int texh) {
     std::vector<Vertex> vertices;
 
     for (auto& poly : polymesh->poly) {
+      if (poly->texture == nullptr && poly->color.x != 0.0F) {
+        // All corners on the centre of the color's palette block.
+        auto* pnode = texToNode[kPaletteTextureName];
+        const int index = PaletteIndex(poly);
+        const float u = (CTAPalette::ImageX(index) + 0.5F) / CTAPalette::kEntriesPerRow;
+        const float v = (CTAPalette::ImageY(index) + 0.5F) / CTAPalette::kEntriesPerRow;
+
+        for (int& vert : poly->verts) {
+          vertices.push_back(polymesh->verts[vert]);
+          Vertex& vrt = vertices.back();
+          vrt.tc[0].x = pnode != nullptr ? tree.GetU(pnode, u) : 0.0F;
+          vrt.tc[0].y = pnode != nullptr ? tree.GetV(pnode, v) : 0.0F;
+          vert = vertices.size() - 1;
+        }
+        continue;
+      }
+
       auto* tnode = texToNode[poly->texname];
 
       if (poly->verts.size() <= 4) {
@@ -615,24 +688,17 @@ bool Model::add_textures_to_atlas(atlas& par_atlas) const {
         }
         textures.insert({poly->texname, poly->texture});
 
-      } else if (poly->color.x != 0.0F) {  // create a new color texture
-        const std::string color_name(SPrintf("color_%d", Vector3ToRGB(poly->color)));
-
-        auto ci_ti = textures.find(color_name);
-        if (ci_ti != textures.end()) {
-          poly->texture = ci_ti->second;
+      } else if (poly->color.x != 0.0F) {  // colors use the palette texture
+        if (textures.find(kPaletteTextureName) != textures.end()) {
           continue;
         }
 
-        auto color_image = std::make_shared<Image>();
-        color_image->name(color_name);
-        if (!color_image->create(1, 1, poly->color.x, poly->color.y, poly->color.z)) {
-          spdlog::error("Failed to create a color image, error was: {}", color_image->error());
+        auto palette_tex = CreatePaletteTexture(par_atlas.margin());
+        if (palette_tex == nullptr) {
+          spdlog::error("Failed to create the palette texture");
           continue;
         }
-
-        auto color_tex = std::make_shared<Texture>(color_image, color_name);
-        textures.insert({color_name, color_tex});
+        textures.insert({kPaletteTextureName, palette_tex});
 
       } else {
         continue;
@@ -640,52 +706,71 @@ bool Model::add_textures_to_atlas(atlas& par_atlas) const {
     }
   }
 
-  std::vector<ImagePtr> add;
+  std::vector<std::shared_ptr<Texture>> add;
+  add.reserve(textures.size());
   for (const auto& texture : textures) {
-    add.push_back(texture.second->GetImage());
+    add.push_back(texture.second);
   }
 
   return par_atlas.add_3do_textures(add, true);
 }
 
 bool Model::convert_to_atlas_s3o(const atlas& par_atlas) {
-  // Map textures
-  std::unordered_map<std::string, atlas_info_image> textures;
+  // Resolve every texture name once, polygons share them.
+  std::unordered_map<std::string, const atlas_info_image*> textures;
 
   std::vector<PolyMesh*> const pmlist = GetPolyMeshList();
 
+  // Atlases from before the palette texture hold a texture per color.
+  const atlas_info& info = par_atlas.info();
+  const bool has_palette = info.find(kPaletteTextureName) != nullptr;
+
   for (auto& polymesh : pmlist) {
     for (auto& poly : polymesh->poly) {
-      if (poly->color.x != 0.0F && poly->texname.empty()) {  // create a new color texture
+      if (poly->color.x != 0.0F && poly->texname.empty()) {
+        if (has_palette) {
+          textures.insert({kPaletteTextureName, nullptr});
+          continue;
+        }
+
         const std::string color_name(SPrintf("color_%d", Vector3ToRGB(poly->color)));
         poly->texname = color_name;
       }
 
       if (!poly->texname.empty()) {
-        auto texname = to_lower(poly->texname);
-
-        if (textures.find(texname) != textures.end()) {
-          continue;
-        }
-
-        if (textures.find(texname+"00") != textures.end()) {
-          continue;
-        }
+        textures.insert({poly->texname, nullptr});
+      }
+    }
+  }
 
-        for (auto const &tex : par_atlas.info().textures) {
-          if (tex.name == texname || tex.name == texname + "00") {
-            textures.insert({texname, tex});
-          }
-        }
+  // A S3O has a single texture, use the page that holds most of the model's textures.
+  std::uint32_t page = 0;
+  std::size_t page_hits = 0;
+  for (std::uint32_t i = 0; i < info.page_count(); i++) {
+    std::size_t hits = 0;
+    for (const auto& texture : textures) {
+      if (info.find(texture.first, i) != nullptr) {
+        hits++;
       }
     }
+
+    if (hits > page_hits) {
+      page = i;
+      page_hits = hits;
+    }
+  }
+
+  for (auto& texture : textures) {
+    texture.second = info.find(texture.first, page);
   }
 
+  const atlas_page page_info = info.page(page);
+
   auto tex1 = std::make_shared<Texture>();
   auto img1 = std::make_shared<Image>();
-  img1->load(par_atlas.info().color_image);
+  img1->load(page_info.color_image);
   tex1->SetImage(img1);
-  tex1->name = std::filesystem::path(par_atlas.info().color_image).filename().string();
+  tex1->name = std::filesystem::path(page_info.color_image).filename().string();
   SetTexture(0, tex1);
 
   auto tex2 = std::make_shared<Texture>();
@@ -712,6 +797,23 @@ bool Model::convert_to_atlas_s3o(const atlas& par_atlas) {
         continue;
       }
 
+      if (poly->texname.empty() && poly->color.x != 0.0F && has_palette) {
+        // All corners on the centre of the color's palette block.
+        const atlas_info_image* pnode = textures[kPaletteTextureName];
+        const int index = PaletteIndex(poly);
+        const float u = (CTAPalette::ImageX(index) + 0.5F) / CTAPalette::kEntriesPerRow;
+        const float v = (CTAPalette::ImageY(index) + 0.5F) / CTAPalette::kEntriesPerRow;
+
+        for (int& vert : poly->verts) {
+          vertices.push_back(polymesh->verts[vert]);
+          Vertex& vrt = vertices.back();
+          vrt.tc[0].x = pnode != nullptr ? pnode->U(page_info.width, info.margin, u, v) : 0.0F;
+          vrt.tc[0].y = pnode != nullptr ? pnode->V(page_info.height, info.margin, u, v) : 0.0F;
+          vert = vertices.size() - 1;
+        }
+        continue;
+      }
+
       if (poly->texname.empty() || poly->verts.size() > 4) {
         for (int& vert : poly->verts) {
           vertices.push_back(polymesh->verts[vert]);
@@ -725,35 +827,26 @@ bool Model::convert_to_atlas_s3o(const atlas& par_atlas) {
         continue;
       }
 
-      std::string texname = to_lower(poly->texname);
-      auto got = textures.find(texname);
-      if (got == textures.end()) {
-        got = textures.find(texname + "00");
-
-        if (got == textures.end()) {
-          for (int& vert : poly->verts) {
-            vertices.push_back(polymesh->verts[vert]);
-            Vertex& vrt = vertices.back();
-            vrt.tc[0].x = vrt.tc[0].y = 0.0F;
-            vert = vertices.size() - 1;
-          }
-
-          // Texture not found.
-          spdlog::warn("texture '{}' not found", texname);
-          continue;
+      const atlas_info_image* tnode = textures[poly->texname];
+      if (tnode == nullptr) {
+        for (int& vert : poly->verts) {
+          vertices.push_back(polymesh->verts[vert]);
+          Vertex& vrt = vertices.back();
+          vrt.tc[0].x = vrt.tc[0].y = 0.0F;
+          vert = vertices.size() - 1;
         }
-      }
 
-      // spdlog::info("loading texture '{}'", texname);
-
-      auto tnode = got->second;
+        // Texture not found (or not on the page the model uses).
+        spdlog::warn("texture '{}' not found on atlas page {}", to_lower(poly->texname), page);
+        continue;
+      }
 
       for (uint v = 0; v < poly->verts.size(); v++) {
         vertices.push_back(polymesh->verts[poly->verts[v]]);
         Vertex& vrt = vertices.back();
         // convert to texturebintree UV coords:
-        vrt.tc[0].x = tnode.U(par_atlas.info().width, tc[v * 2 + 0]);
-        vrt.tc[0].y = tnode.V(par_atlas.info().height, tc[v * 2 + 1]);
+        vrt.tc[0].x = tnode->U(page_info.width, info.margin, tc[v * 2 + 0], tc[v * 2 + 1]);
+        vrt.tc[0].y = tnode->V(page_info.height, info.margin, tc[v * 2 + 0], tc[v * 2 + 1]);
 
         poly->verts[v] = vertices.size() - 1;
       }
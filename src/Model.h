@@ -307,14 +307,25 @@ struct Model {
   void PostLoad();
 
   bool Load3DO(const char* filename, IProgressCtl& progctl = defprogctl);
+  bool Load3DO(FILE* f);
   bool Save3DO(const char* fn, IProgressCtl& progctl = defprogctl) const;
 
   bool LoadS3O(const char* filename, IProgressCtl& progctl = defprogctl);
+  // filename is only used for messages and to find the textures, when load_textures is set
+  bool LoadS3O(FILE* fp, const char* filename, bool load_textures);
   bool SaveS3O(const char* filename, IProgressCtl& progctl = defprogctl);
 
   static Model* Load(const std::string& fn, bool Optimize = true,
                      IProgressCtl& progctl = defprogctl);
   static bool Save(Model* mdl, const std::string& fn, IProgressCtl& progctl = defprogctl);
+  /**
+   * Loads a .3do or .s3o from memory, par_name provides the extension. Textures are only
+   * referenced by name. Shows no messages, so it can run on worker threads once the TA palette
+   * is loaded.
+   * @param par_error set to the reason when nullptr is returned
+   */
+  static Model* load_from_memory(std::span<const std::uint8_t> par_buffer,
+                                 const std::string& par_name, std::string* par_error = nullptr);
 
   // exports merged version of the model
   bool ExportUVMesh(const char* fn) const;
@@ -339,7 +350,8 @@ struct Model {
   void SetTextureName(uint index, const char* name);
   void SetTexture(uint index, std::shared_ptr<Texture> par_tex);
 
-  bool ConvertToS3O(std::string textureName, int texw, int texh);
+  // texw/texh are the smallest atlas size, it grows (power of two) until all textures fit.
+  bool ConvertToS3O(std::string textureName, int texw = 0, int texh = 0);
 
   bool add_textures_to_atlas(atlas& par_atlas) const;
   bool convert_to_atlas_s3o(const atlas& par_atlas);
@@ -10,6 +10,7 @@
 #include "EditorDef.h"
 #include "EditorIncl.h"
 #include "EditorUI.h"
+#include "Image.h"
 
 TexBuilderUI::TexBuilderUI(const char* tex1, const char* tex2) {
   CreateUI();
@@ -77,6 +78,7 @@ void freeimgs(ILuint a, ILuint b) {
 }
 
 void TexBuilderUI::BuildTexture1() {
+  const std::lock_guard<std::recursive_mutex> lock(Image::devil_mutex());
   ILuint color = 0;
   ILuint teamcol = 0;
 
@@ -147,6 +149,7 @@ void TexBuilderUI::BuildTexture1() {
 }
 
 void TexBuilderUI::BuildTexture2() {
+  const std::lock_guard<std::recursive_mutex> lock(Image::devil_mutex());
   ILuint reflect = 0;
   ILuint selfillum = 0;
 
@@ -10,9 +10,8 @@
 #include "Image.h"
 #include "CfgParser.h"
 
-#include "FileSystem/CDirectoryArchive.h"
-#include "FileSystem/CSevenZipArchive.h"
-#include "FileSystem/CZipArchive.h"
+#include "FileSystem/CPrefetchReader.h"
+#include "FileSystem/CVirtualFileSystem.h"
 
 #include <IL/il.h>
 #include <IL/ilu.h>
@@ -24,8 +23,11 @@
 #include "string_util.h"
 #include "spdlog/spdlog.h"
 
+#include <cstring>
 #include <filesystem>
+#include <unordered_set>
 #include <utility>
+#include <vector>
 
 // ------------------------------------------------------------------------------------------------
 // Texture
@@ -41,7 +43,7 @@ Texture::Texture(const std::string& par_filename, const std::string& hintpath) :
   Load(par_filename, hintpath);
 }
 
-Texture::Texture(std::vector<std::uint8_t>& par_data, const std::string& par_path,
+Texture::Texture(std::span<const std::uint8_t> par_data, const std::string& par_path,
                  const std::string& par_name, bool par_is_teamcolor)
     : name(par_name), glIdent(0) {
   auto img = std::make_shared<Image>();
@@ -99,7 +101,49 @@ bool Texture::Load(const std::string& par_filename, const std::string& par_hintp
   return true;
 }
 
-void Texture::SetImage(std::shared_ptr<Image> img) { image = img; }
+void Texture::SetImage(std::shared_ptr<Image> img) {
+  std::lock_guard<std::mutex> const lock(variantsMutex_);
+  variants_.clear();
+  image = img;
+}
+
+std::shared_ptr<Image> Texture::GetVariant(std::uint32_t par_variant) {
+  // SetImage() may swap the image meanwhile.
+  std::lock_guard<std::mutex> const lock(variantsMutex_);
+  if (image == nullptr or par_variant == TEXVAR_SOURCE) {
+    return image;
+  }
+
+  if (auto it = variants_.find(par_variant); it != variants_.end()) {
+    return it->second;
+  }
+
+  // Failed variants are returned with their error set but not cached, the next call retries.
+  auto img = image->clone();
+  if (img->has_error()) {
+    spdlog::error("'{}' clone failed, error was: {}", name, img->error());
+    return img;
+  }
+
+  if ((par_variant & TEXVAR_POW2) != 0 and !img->to_power_of_two()) {
+    spdlog::error("'{}' to_power_of_two failed, error was: {}", name, img->error());
+    return img;
+  }
+
+  // On teamcolor we copy the red channel to green, on normal textures we add a opaque alpha.
+  if ((par_variant & TEXVAR_TEAMCOLOR) != 0) {
+    if (!img->threedo_to_s3o()) {
+      spdlog::error("'{}' threedo_to_s3o failed, error was: {}", name, img->error());
+      return img;
+    }
+  } else if ((par_variant & TEXVAR_OPAQUE) != 0 and !img->add_opaque_alpha()) {
+    spdlog::error("'{}' add_opaque_alpha failed, error was: {}", name, img->error());
+    return img;
+  }
+
+  variants_.emplace(par_variant, img);
+  return img;
+}
 
 Texture::~Texture() {
   if (glIdent != 0) {
@@ -108,6 +152,28 @@ Texture::~Texture() {
   }
 }
 
+namespace {
+
+// Uploads one mipmap level, par_reverse_rows flips top down images into par_scratch first so
+// every level still goes up in a single call.
+void upload_level(GLint par_level, GLint par_format, int par_width, int par_height, int par_bpp,
+                  const std::uint8_t* par_data, bool par_reverse_rows,
+                  std::vector<std::uint8_t>& par_scratch) {
+  if (par_reverse_rows) {
+    const std::size_t pitch = static_cast<std::size_t>(par_width) * par_bpp;
+    par_scratch.resize(pitch * par_height);
+    for (int y = 0; y < par_height; y++) {
+      std::memcpy(par_scratch.data() + (par_height - 1 - y) * pitch, par_data + y * pitch, pitch);
+    }
+    par_data = par_scratch.data();
+  }
+
+  glTexImage2D(GL_TEXTURE_2D, par_level, par_format, par_width, par_height, 0, par_format,
+               GL_UNSIGNED_BYTE, par_data);
+}
+
+}  // namespace
+
 bool Texture::VideoInit() {
   if (image == nullptr or image->has_error()) {
     return false;
@@ -120,8 +186,39 @@ bool Texture::VideoInit() {
 
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-  gluBuild2DMipmaps(GL_TEXTURE_2D, format, image->width(), image->height(), format,
-                    GL_UNSIGNED_BYTE, image->data());
+
+  const auto mipmaps = image->mipmaps(MipFilter::Box);
+  if (mipmaps.empty() && (image->width() > 1 || image->height() > 1)) {
+    // The variants get cloned from image, flip a copy.
+    auto upload = image;
+    if (image->origin() != ImageOrigin::LowerLeft) {
+      upload = image->clone();
+      if (!upload->to_origin(ImageOrigin::LowerLeft)) {
+        return false;
+      }
+    }
+
+    gluBuild2DMipmaps(GL_TEXTURE_2D, format, upload->width(), upload->height(), format,
+                      GL_UNSIGNED_BYTE, upload->data());
+    return true;
+  }
+
+  // Upload the precomputed chain, RGB rows aren't 4 byte aligned.
+  GLint alignment = 4;
+  glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+  const bool reverse_rows = image->origin() == ImageOrigin::UpperLeft;
+  std::vector<std::uint8_t> scratch;
+  upload_level(0, format, image->width(), image->height(), image->bpp(), image->data(),
+               reverse_rows, scratch);
+  for (std::size_t level = 0; level < mipmaps.size(); level++) {
+    upload_level(static_cast<GLint>(level + 1), format, mipmaps[level].width,
+                 mipmaps[level].height, image->bpp(), mipmaps[level].data.data(), reverse_rows,
+                 scratch);
+  }
+
+  glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
   return true;
 }
 
@@ -163,33 +260,26 @@ bool TextureHandler::has_team_color(const std::string& texture_name) {
 
 bool TextureHandler::LoadFiltered(
     const std::string& par_archive_path,
-    std::function<const std::string(const std::string&)>&& par_filter) {
-  std::shared_ptr<IArchive> archive;
-
-  auto path = std::filesystem::absolute(par_archive_path);
-  if (std::filesystem::is_directory(path)) {
-    archive = std::make_shared<CDirectoryArchive>(par_archive_path);
-  } else {
-    auto ext = path.extension();
-    if (ext == ".7z" or ext == ".sd7") {
-      archive = std::make_shared<CSevenZipArchive>(par_archive_path);
-    } else if (ext == ".zip") {
-      archive = std::make_shared<CZipArchive>(par_archive_path);
-    } else {
-      spdlog::error("Unknown archive '{}'", path.string());
-      return false;
-    }
+    std::function<const std::string(const std::string&)>&& par_filter,
+    const std::vector<std::string>& par_prefixes) {
+  CVirtualFileSystem vfs;
+  if (!vfs.Mount(par_archive_path, par_prefixes)) {
+    return false;
   }
 
-  if (archive->NumFiles() == 0) {
+  return LoadFiltered(vfs, std::move(par_filter));
+}
+
+bool TextureHandler::LoadFiltered(
+    const CVirtualFileSystem& par_vfs,
+    std::function<const std::string(const std::string&)>&& par_filter, bool par_replace) {
+  if (par_vfs.NumFiles() == 0) {
     return false;
   }
 
   // Read teamcolors.
-  if (archive->FileExists("unittextures/tatex/teamtex.txt")) {
-    std::vector<std::uint8_t> buff;
-    archive->GetFileByName("unittextures/tatex/teamtex.txt", buff);
-
+  std::vector<std::uint8_t> buff;
+  if (par_vfs.GetFile("unittextures/tatex/teamtex.txt", buff)) {
     std::stringstream stringstream(std::string(reinterpret_cast<char*>(buff.data()), buff.size()));
 
     // teamcolors_.reserve(32);
@@ -203,12 +293,19 @@ bool TextureHandler::LoadFiltered(
     spdlog::error("no file 'unittextures/tatex/teamtex.txt' in archive");
   }
 
-  for (std::uint32_t i = 0; i < archive->NumFiles(); i++) {
-    std::string name;
+  // Pick the files first, then read them in one go, which lets solid archives decompress every
+  // block only once.
+  std::vector<std::size_t> indices;
+  std::unordered_map<std::size_t, std::string> internal_names;
+  std::unordered_set<std::string> picked;
+  for (std::size_t i = 0; i < par_vfs.NumFiles(); i++) {
+    const auto& file = par_vfs.File(i);
+    const std::string& name = file.name;
+
+    std::string orig_name;
     int size = 0;
     int mode = 0;
-
-    archive->FileInfo(i, name, size, mode);
+    file.archive->FileInfo(file.fid, orig_name, size, mode);
 
     if (size < 1 || name.empty()) {
       continue;
@@ -232,27 +329,48 @@ bool TextureHandler::LoadFiltered(
 
     // spdlog::debug("loading {} as {}", name, internal_name);
 
-    if (textures_.find(internal_name) != textures_.end()) {
-      spdlog::debug("Skipping texture '{}' its already known", internal_name);
+    if (!picked.insert(internal_name).second) {
       continue;
     }
 
-    // Load from archive
-    std::vector<std::uint8_t> buf;
-    archive->GetFile(i, buf);
+    if (textures_.find(internal_name) != textures_.end()) {
+      const auto it_source = sources_.find(internal_name);
+      const bool same_file = it_source != sources_.end() &&
+                             it_source->second.archive.lock() == file.archive &&
+                             it_source->second.fid == file.fid;
+      if (!par_replace || same_file) {
+        spdlog::debug("Skipping texture '{}' its already known", internal_name);
+        continue;
+      }
+    }
+
+    indices.push_back(i);
+    internal_names.insert({i, internal_name});
+  }
+
+  // Decoding overlaps with reading the next files.
+  CPrefetchReader reader(par_vfs);
+  reader.Submit(std::move(indices));
+  reader.Close();
 
-    if (buf.empty()) {
+  CPrefetchReader::File file;
+  while (reader.Next(file)) {
+    const auto& name = par_vfs.File(file.fid).name;
+    const auto& internal_name = internal_names[file.fid];
+    if (file.data.empty()) {
       spdlog::debug("Failed to read texture file '{}' from the archive", internal_name);
       continue;
     }
 
-    auto tex = std::make_shared<Texture>(buf, name, internal_name, has_team_color(internal_name));
+    auto tex =
+        std::make_shared<Texture>(file.data, name, internal_name, has_team_color(internal_name));
     if (tex->HasError()) {
       continue;
     }
 
     // Assign to map
     textures_[tex->name] = tex;
+    sources_[tex->name] = {par_vfs.File(file.fid).archive, par_vfs.File(file.fid).fid};
   }
 
   spdlog::debug("Loaded '{}' textures and '{}' teamcolors", textures_.size(), teamcolors_.size());
@@ -371,19 +489,33 @@ TextureBinTree::Node::Node(int X, int Y, int W, int H) : x(X), y(Y), w(W), h(H)
   child[0] = child[1] = nullptr;
 }
 
-TextureBinTree::Node::~Node() {
-  SAFE_DELETE(child[0]);
-  SAFE_DELETE(child[1]);
-}
-
 TextureBinTree::TextureBinTree(int par_width, int par_height) : TextureBinTree() {
+  if (par_width <= 0 || par_height <= 0) {
+    return;
+  }
+
   if (!image_->create(par_width, par_height)) {
     spdlog::error("Failed to create the atlas image with size '{}/{}', error was: {}", par_width,
                   par_height, image_->error());
   }
 };
 
-TextureBinTree::~TextureBinTree() { SAFE_DELETE(tree); }
+TextureBinTree::Node* TextureBinTree::NewNode(int X, int Y, int W, int H) {
+  return &nodes_.emplace_back(X, Y, W, H);
+}
+
+bool TextureBinTree::Reset(int par_width, int par_height) {
+  tree = nullptr;
+  nodes_.clear();
+
+  image_ = std::make_shared<Image>();
+  if (!image_->create(par_width, par_height)) {
+    spdlog::error("Failed to create the atlas image with size '{}/{}', error was: {}", par_width,
+                  par_height, image_->error());
+    return false;
+  }
+  return true;
+}
 
 void TextureBinTree::StoreNode(Node* n, const std::shared_ptr<Image> par_tex) {
   n->img_w = par_tex->width();
@@ -396,28 +528,33 @@ void TextureBinTree::StoreNode(Node* n, const std::shared_ptr<Image> par_tex) {
 }
 
 TextureBinTree::Node* TextureBinTree::InsertNode(Node* n, int w, int h) {
-  if ((n->child[0] != nullptr) || (n->child[1] != nullptr))  // not a leaf node ?
-  {
-    Node* r = nullptr;
-    if (n->child[0] != nullptr) {
-      r = InsertNode(n->child[0], w, h);
-    }
-    if (r != nullptr) {
-      return r;
-    }
-    if (n->child[1] != nullptr) {
-      r = InsertNode(n->child[1], w, h);
+  // Depth first, child 0 before child 1.
+  stack_.clear();
+  stack_.push_back(n);
+
+  while (!stack_.empty()) {
+    n = stack_.back();
+    stack_.pop_back();
+
+    if ((n->child[0] != nullptr) || (n->child[1] != nullptr))  // not a leaf node ?
+    {
+      if (n->child[1] != nullptr) {
+        stack_.push_back(n->child[1]);
+      }
+      if (n->child[0] != nullptr) {
+        stack_.push_back(n->child[0]);
+      }
+      continue;
     }
-    return r;
-  } else {
+
     // Occupied
     if (n->img_w != 0) {
-      return nullptr;
+      continue;
     }
 
     // Does it fit ?
     if (n->w < w || n->h < h) {
-      return nullptr;
+      continue;
     }
 
     if (n->w == w && n->h == h) {
@@ -429,18 +566,18 @@ TextureBinTree::Node* TextureBinTree::InsertNode(Node* n, int w, int h) {
     if (ow > oh) {
       // Split vertically
       if (ow != 0) {
-        n->child[0] = new Node(n->x + w, n->y, ow, n->h);
+        n->child[0] = NewNode(n->x + w, n->y, ow, n->h);
       }
       if (oh != 0) {
-        n->child[1] = new Node(n->x, n->y + h, w, oh);
+        n->child[1] = NewNode(n->x, n->y + h, w, oh);
       }
     } else {
       // Split horizontally
       if (ow != 0) {
-        n->child[0] = new Node(n->x + w, n->y, ow, h);
+        n->child[0] = NewNode(n->x + w, n->y, ow, h);
       }
       if (oh != 0) {
-        n->child[1] = new Node(n->x, n->y + h, n->w, oh);
+        n->child[1] = NewNode(n->x, n->y + h, n->w, oh);
       }
     }
 
@@ -457,7 +594,7 @@ TextureBinTree::Node* TextureBinTree::AddNode(const std::shared_ptr<Image> par_s
       return nullptr;
     }
 
-    tree = new Node(0, 0, image_->width(), image_->height());
+    tree = NewNode(0, 0, image_->width(), image_->height());
   }
 
   auto* pn = InsertNode(tree, par_subtex->width(), par_subtex->height());
@@ -467,4 +604,94 @@ TextureBinTree::Node* TextureBinTree::AddNode(const std::shared_ptr<Image> par_s
 
   StoreNode(pn, par_subtex);
   return pn;
-}
\ No newline at end of file
+}
+
+bool TextureBinTree::AddNodes(const std::vector<std::shared_ptr<Image>>& par_images,
+                              std::vector<Node*>& par_nodes) {
+  constexpr int kMaxSize = 16384;
+
+  std::vector<std::size_t> order(par_images.size());
+  std::uint64_t area = 0;
+  int width = std::max(image_->width(), 1);
+  int height = std::max(image_->height(), 1);
+  for (std::size_t i = 0; i < order.size(); i++) {
+    order[i] = i;
+    area += static_cast<std::uint64_t>(par_images[i]->width()) * par_images[i]->height();
+    width = std::max(width, par_images[i]->width());
+    height = std::max(height, par_images[i]->height());
+  }
+
+  // Longest side first, then the larger area, packs much tighter than the input order.
+  std::stable_sort(order.begin(), order.end(), [&](std::size_t par_a, std::size_t par_b) {
+    const auto& a = par_images[par_a];
+    const auto& b = par_images[par_b];
+    const int side_a = std::max(a->width(), a->height());
+    const int side_b = std::max(b->width(), b->height());
+    if (side_a != side_b) {
+      return side_a > side_b;
+    }
+    return a->width() * a->height() > b->width() * b->height();
+  });
+
+  const auto grow = [&width, &height]() {
+    const auto next_power_of_two = [](int par_value) {
+      int result = 1;
+      while (result < par_value) {
+        result <<= 1;
+      }
+      return result;
+    };
+
+    if (width != next_power_of_two(width) || height != next_power_of_two(height)) {
+      width = next_power_of_two(width);
+      height = next_power_of_two(height);
+    } else if (width <= height) {
+      width *= 2;
+    } else {
+      height *= 2;
+    }
+  };
+
+  // No point in trying sizes smaller than the images.
+  while (static_cast<std::uint64_t>(width) * height < area) {
+    grow();
+  }
+
+  for (;;) {
+    if (width > kMaxSize || height > kMaxSize) {
+      spdlog::error("Not enough texture space for all textures in {0}x{0}", kMaxSize);
+      return false;
+    }
+
+    if ((width != image_->width() || height != image_->height() || tree != nullptr) &&
+        !Reset(width, height)) {
+      return false;
+    }
+    tree = NewNode(0, 0, width, height);
+
+    par_nodes.assign(par_images.size(), nullptr);
+    bool fits = true;
+    for (const std::size_t index : order) {
+      Node* node = InsertNode(tree, par_images[index]->width(), par_images[index]->height());
+      if (node == nullptr) {
+        fits = false;
+        break;
+      }
+
+      // Mark it as occupied, the pixels only get copied once everything fits.
+      node->img_w = par_images[index]->width();
+      node->img_h = par_images[index]->height();
+      par_nodes[index] = node;
+    }
+
+    if (fits) {
+      for (std::size_t i = 0; i < par_images.size(); i++) {
+        StoreNode(par_nodes[i], par_images[i]);
+      }
+      return true;
+    }
+
+    spdlog::debug("Textures don't fit in {}x{}, growing", width, height);
+    grow();
+  }
+}
@@ -5,25 +5,36 @@
 //-----------------------------------------------------------------------
 #pragma once
 
+#include <deque>
 #include <memory>
+#include <mutex>
 #include <set>
 #include <unordered_map>
 #include <functional>
 #include <filesystem>
 
 #include "FileSystem/IArchive.h"
+#include "FileSystem/CVirtualFileSystem.h"
 
 #include "Referenced.h"
 #include "Image.h"
 
 class CfgList;
 
+// Transforms to derive an image from the source image of a texture, see Texture::GetVariant.
+enum TextureVariant : std::uint32_t {
+  TEXVAR_SOURCE = 0,
+  TEXVAR_POW2 = 1U << 0,       // Image::to_power_of_two
+  TEXVAR_TEAMCOLOR = 1U << 1,  // Image::threedo_to_s3o
+  TEXVAR_OPAQUE = 1U << 2,     // Image::add_opaque_alpha
+};
+
 class Texture {
  public:
   Texture();
   Texture(const std::string& filename);
   Texture(const std::string& filename, const std::string& hintpath);
-  Texture(std::vector<std::uint8_t>& par_data, const std::string& par_path,
+  Texture(std::span<const std::uint8_t> par_data, const std::string& par_path,
           const std::string& par_name, bool par_is_teamcolor);
   Texture(std::shared_ptr<Image> par_image, const std::string& par_name)
       : glIdent(), name(par_name) {
@@ -38,6 +49,11 @@ class Texture {
   std::shared_ptr<Image> GetImage() { return image; };
   void SetImage(std::shared_ptr<Image> img);
 
+  // Returns a copy of image with the given TextureVariant flags applied, pow2 first.
+  // Every variant gets created once and is shared afterwards, image itself is never modified.
+  // Safe to call from several threads, the conversions go through Image::devil_mutex().
+  std::shared_ptr<Image> GetVariant(std::uint32_t par_variant);
+
   inline int Width() const { return image->width(); }
   inline int Height() const { return image->height(); }
 
@@ -46,6 +62,10 @@ class Texture {
   std::shared_ptr<Image> image;
 
   static std::string textureLoadDir;
+
+ private:
+  std::mutex variantsMutex_;
+  std::unordered_map<std::uint32_t, std::shared_ptr<Image>> variants_;
 };
 
 // manages 3do textures
@@ -55,6 +75,24 @@ class TextureHandler {
   std::unordered_map<std::string, std::shared_ptr<Texture>> textures_;
   std::set<std::string> teamcolors_;
 
+  // Archive entry every texture loaded from a CVirtualFileSystem came from.
+  struct TextureSource {
+    std::weak_ptr<IArchive> archive;
+    std::size_t fid;
+  };
+  std::unordered_map<std::string, TextureSource> sources_;
+
+  // "unittextures/tatex/foo.bmp" -> "foo"
+  static const std::string filter_3do(const std::string& par_path) {
+    if (par_path.rfind("unittextures/tatex/", 0) == 0) {
+      auto result = std::filesystem::path(par_path).replace_extension("").string();
+      result = result.substr(std::string("unittextures/tatex/").length());
+
+      return result;
+    }
+    return "";
+  }
+
  public:
   TextureHandler() : textures_(), teamcolors_() {}
   virtual ~TextureHandler() = default;
@@ -65,18 +103,26 @@ class TextureHandler {
   TextureHandler operator=(TextureHandler&& rhs) = delete;
 
   bool Load3DO(const std::string& par_archive_path) {
-    return LoadFiltered(par_archive_path, [](const std::string& par_path) -> const std::string {
-      if (par_path.rfind("unittextures/tatex/", 0) == 0) {
-        auto result = std::filesystem::path(par_path).replace_extension("").string();
-        result = result.substr(std::string("unittextures/tatex/").length());
-
-        return result;
-      }
-      return "";
-    });
+    return LoadFiltered(par_archive_path, filter_3do, {"unittextures/tatex/"});
   };
+  bool Load3DO(const CVirtualFileSystem& par_vfs, bool par_replace = false) {
+    return LoadFiltered(par_vfs, filter_3do, par_replace);
+  };
+  /**
+   * par_prefixes limits which part of a directory archive gets scanned, it should cover every
+   * path par_filter accepts.
+   */
   bool LoadFiltered(const std::string& par_archive_path,
-                    std::function<const std::string(const std::string&)>&& par_filter);
+                    std::function<const std::string(const std::string&)>&& par_filter,
+                    const std::vector<std::string>& par_prefixes = {});
+  /**
+   * Loads the textures every file in par_vfs resolves to, files hidden by a later mounted archive
+   * are left alone. Textures that are already known are skipped, with par_replace they are loaded
+   * again if par_vfs now resolves them to a different file (after mounting another archive).
+   */
+  bool LoadFiltered(const CVirtualFileSystem& par_vfs,
+                    std::function<const std::string(const std::string&)>&& par_filter,
+                    bool par_replace = false);
   std::shared_ptr<Texture> texture(const std::string& name);
 
   bool has_team_color(const std::string& texture_name);
@@ -112,10 +158,10 @@ used for lightmap packing
 */
 class TextureBinTree {
  public:
+  // Nodes live in the tree's arena, they stay valid until the tree starts over or dies.
   struct Node {
     Node();
     Node(int X, int Y, int W, int H);
-    ~Node();
 
     int x, y, w, h;
     int img_w, img_h;
@@ -123,11 +169,20 @@ class TextureBinTree {
   };
 
   TextureBinTree() : render_id(), tree(), image_(std::make_shared<Image>()){};
+  // No image gets created for a size of 0, AddNodes() then picks one.
   TextureBinTree(int par_width, int par_height);
-  virtual ~TextureBinTree();
+  virtual ~TextureBinTree() = default;
 
   Node* AddNode(const std::shared_ptr<Image> par_subtex);
 
+  /**
+   * Adds par_images largest first. When they don't fit, the tree starts over with the next
+   * power of two size (the shorter side grows first), so the size given to the constructor is
+   * only a minimum. par_nodes gets the node of every image, in the order of par_images.
+   */
+  bool AddNodes(const std::vector<std::shared_ptr<Image>>& par_images,
+                std::vector<Node*>& par_nodes);
+
   bool IsEmpty() { return !tree; }
 
   inline float GetU(Node* n, float u) {
@@ -145,7 +200,11 @@ class TextureBinTree {
  protected:
   void StoreNode(Node* n, const std::shared_ptr<Image> par_tex);
   Node* InsertNode(Node* n, int w, int h);
+  Node* NewNode(int X, int Y, int W, int H);
+  bool Reset(int par_width, int par_height);
 
   Node* tree;
   std::shared_ptr<Image> image_;
+  std::deque<Node> nodes_;
+  std::vector<Node*> stack_;  // InsertNode's traversal
 };
\ No newline at end of file
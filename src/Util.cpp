@@ -19,6 +19,28 @@ std::string ReadZStr(FILE* f) {
   return s;
 }
 
+FILE* OpenMemoryFile(const std::uint8_t* data, std::size_t size) {
+  if (size == 0) {
+    return nullptr;
+  }
+
+#ifdef _WIN32
+  // No fmemopen(), go through a temporary file.
+  FILE* f = tmpfile();
+  if (f == nullptr) {
+    return nullptr;
+  }
+  if (fwrite(data, size, 1, f) != 1) {
+    fclose(f);
+    return nullptr;
+  }
+  rewind(f);
+  return f;
+#else
+  return fmemopen(const_cast<std::uint8_t*>(data), size, "rb");
+#endif
+}
+
 void WriteZStr(FILE* f, const std::string& s) {
   std::size_t const c = s.length();
   fwrite(s.data(), c + 1, 1, f);
@@ -5,6 +5,8 @@
 //-----------------------------------------------------------------------
 #pragma once
 
+#include <cstdint>
+#include <cstdio>
 #include <string>
 
 #include "DebugTrace.h"
@@ -45,6 +47,8 @@ struct InputBuffer {
 
 std::string Readstring(int offset, FILE* f);
 std::string ReadZStr(FILE* f);
+// A read-only FILE over data, which has to stay valid until fclose().
+FILE* OpenMemoryFile(const std::uint8_t* data, std::size_t size);
 void WriteZStr(FILE* f, const std::string& s);
 std::string GetFilePath(const std::string& fn);
 void AddTrailingSlash(std::string& tld);
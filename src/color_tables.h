@@ -0,0 +1,46 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+namespace ups {
+
+// Number of entries in the linear to sRGB table, enough for < 0.25 steps of error near black.
+constexpr int kLinearTableSize = 16384;
+
+struct ColorTables {
+  float to_linear[256];
+  std::uint8_t from_linear[kLinearTableSize];
+
+  explicit ColorTables(bool par_srgb) {
+    for (int i = 0; i < 256; i++) {
+      const float value = static_cast<float>(i) / 255.0F;
+      if (!par_srgb) {
+        to_linear[i] = value;
+      } else if (value <= 0.04045F) {
+        to_linear[i] = value / 12.92F;
+      } else {
+        to_linear[i] = std::pow((value + 0.055F) / 1.055F, 2.4F);
+      }
+    }
+
+    for (int i = 0; i < kLinearTableSize; i++) {
+      const float value = static_cast<float>(i) / (kLinearTableSize - 1);
+      float encoded = value;
+      if (par_srgb) {
+        encoded = value <= 0.0031308F ? value * 12.92F
+                                      : 1.055F * std::pow(value, 1.0F / 2.4F) - 0.055F;
+      }
+      from_linear[i] = static_cast<std::uint8_t>(std::clamp(encoded * 255.0F + 0.5F, 0.0F, 255.0F));
+    }
+  }
+};
+
+inline const ColorTables& color_tables(bool par_srgb) {
+  static const ColorTables srgb(true);
+  static const ColorTables linear(false);
+  return par_srgb ? srgb : linear;
+}
+
+};  // namespace ups
@@ -1,3 +1,30 @@
 #include "config.h"
 
-namespace ups {};  // namespace ups
\ No newline at end of file
+#include <cstdlib>
+
+namespace ups {
+
+std::filesystem::path config::cache_path() {
+  if (!cache_path_.empty()) {
+    return cache_path_;
+  }
+
+#ifdef _WIN32
+  if (const char* local = std::getenv("LOCALAPPDATA"); local != nullptr && *local != '\0') {
+    cache_path_ = std::filesystem::path(local) / "upspring";
+  }
+#else
+  if (const char* xdg = std::getenv("XDG_CACHE_HOME"); xdg != nullptr && *xdg != '\0') {
+    cache_path_ = std::filesystem::path(xdg) / "upspring";
+  } else if (const char* home = std::getenv("HOME"); home != nullptr && *home != '\0') {
+    cache_path_ = std::filesystem::path(home) / ".cache" / "upspring";
+  }
+#endif
+
+  if (cache_path_.empty()) {
+    cache_path_ = app_path() / "cache";
+  }
+  return cache_path_;
+}
+
+};  // namespace ups
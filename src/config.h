@@ -9,6 +9,7 @@ class config {
   config() : app_path_(){};
 
   std::string app_path_;
+  std::filesystem::path cache_path_;
 
  public:
   static config& get() {
@@ -24,6 +25,10 @@ class config {
     app_path_ = std::filesystem::canonical(par_app_path).string();
   }
   std::filesystem::path app_path() { return app_path_; }
+
+  void cache_path(std::filesystem::path par_cache_path) { cache_path_ = par_cache_path; }
+  // Defaults to %LOCALAPPDATA%/upspring, $XDG_CACHE_HOME/upspring or ~/.cache/upspring.
+  std::filesystem::path cache_path();
 };
 
 };  // namespace ups
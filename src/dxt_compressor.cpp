@@ -0,0 +1,731 @@
+#include "dxt_compressor.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define DXT_USE_SSE2 1
+#endif
+
+#include "color_tables.h"
+#include "nv_dds.h"
+#include "parallel.h"
+
+#include "spdlog/spdlog.h"
+
+namespace dxt {
+namespace {
+
+// 4x4 pixels, colors as structure of arrays so four pixels fit into one SSE register.
+struct Block {
+  alignas(16) float r[16];
+  alignas(16) float g[16];
+  alignas(16) float b[16];
+  std::uint8_t a[16];
+};
+
+struct Color {
+  float r, g, b;
+};
+
+void load_block(const Level& par_level, int par_bx, int par_by, Block& par_block) {
+  for (int y = 0; y < 4; y++) {
+    // Blocks on the border repeat the last row/column.
+    const int sy = std::min(par_by * 4 + y, par_level.height - 1);
+    const std::uint8_t* row = par_level.rgba + sy * par_level.pitch;
+
+    for (int x = 0; x < 4; x++) {
+      const int sx = std::min(par_bx * 4 + x, par_level.width - 1);
+      const std::uint8_t* pixel = row + static_cast<std::ptrdiff_t>(sx) * par_level.channels;
+      const int i = y * 4 + x;
+
+      par_block.r[i] = pixel[0];
+      par_block.g[i] = pixel[1];
+      par_block.b[i] = pixel[2];
+      par_block.a[i] = par_level.channels > 3 ? pixel[3] : 255;
+    }
+  }
+}
+
+std::uint16_t pack565(const Color& par_color) {
+  const int r = std::clamp(static_cast<int>(par_color.r * (31.0F / 255.0F) + 0.5F), 0, 31);
+  const int g = std::clamp(static_cast<int>(par_color.g * (63.0F / 255.0F) + 0.5F), 0, 63);
+  const int b = std::clamp(static_cast<int>(par_color.b * (31.0F / 255.0F) + 0.5F), 0, 31);
+  return static_cast<std::uint16_t>((r << 11) | (g << 5) | b);
+}
+
+Color unpack565(std::uint16_t par_color) {
+  const int r = (par_color >> 11) & 31;
+  const int g = (par_color >> 5) & 63;
+  const int b = par_color & 31;
+  return {static_cast<float>((r << 3) | (r >> 2)), static_cast<float>((g << 2) | (g >> 4)),
+          static_cast<float>((b << 3) | (b >> 2))};
+}
+
+Color mix(const Color& par_a, const Color& par_b, float par_t) {
+  return {par_a.r + (par_b.r - par_a.r) * par_t, par_a.g + (par_b.g - par_a.g) * par_t,
+          par_a.b + (par_b.b - par_a.b) * par_t};
+}
+
+// Picks the nearest of par_count palette colors for every pixel, returns the squared error.
+float select_indices(const Block& par_block, const Color* par_palette, int par_count,
+                     std::uint8_t* par_indices) {
+  float error = 0.0F;
+
+#ifdef DXT_USE_SSE2
+  for (int q = 0; q < 16; q += 4) {
+    const __m128 r = _mm_load_ps(par_block.r + q);
+    const __m128 g = _mm_load_ps(par_block.g + q);
+    const __m128 b = _mm_load_ps(par_block.b + q);
+
+    __m128 best = _mm_set1_ps(FLT_MAX);
+    __m128i best_index = _mm_setzero_si128();
+    for (int k = 0; k < par_count; k++) {
+      const __m128 dr = _mm_sub_ps(r, _mm_set1_ps(par_palette[k].r));
+      const __m128 dg = _mm_sub_ps(g, _mm_set1_ps(par_palette[k].g));
+      const __m128 db = _mm_sub_ps(b, _mm_set1_ps(par_palette[k].b));
+      const __m128 dist =
+          _mm_add_ps(_mm_add_ps(_mm_mul_ps(dr, dr), _mm_mul_ps(dg, dg)), _mm_mul_ps(db, db));
+
+      const __m128i closer = _mm_castps_si128(_mm_cmplt_ps(dist, best));
+      best = _mm_min_ps(dist, best);
+      best_index = _mm_or_si128(_mm_and_si128(closer, _mm_set1_epi32(k)),
+                                _mm_andnot_si128(closer, best_index));
+    }
+
+    alignas(16) float best_out[4];
+    alignas(16) std::int32_t index_out[4];
+    _mm_store_ps(best_out, best);
+    _mm_store_si128(reinterpret_cast<__m128i*>(index_out), best_index);
+    for (int i = 0; i < 4; i++) {
+      par_indices[q + i] = static_cast<std::uint8_t>(index_out[i]);
+      error += best_out[i];
+    }
+  }
+#else
+  for (int i = 0; i < 16; i++) {
+    float best = FLT_MAX;
+    for (int k = 0; k < par_count; k++) {
+      const float dr = par_block.r[i] - par_palette[k].r;
+      const float dg = par_block.g[i] - par_palette[k].g;
+      const float db = par_block.b[i] - par_palette[k].b;
+      const float dist = dr * dr + dg * dg + db * db;
+      if (dist < best) {
+        best = dist;
+        par_indices[i] = static_cast<std::uint8_t>(k);
+      }
+    }
+    error += best;
+  }
+#endif
+
+  return error;
+}
+
+void bounding_box_endpoints(const Block& par_block, Color& par_e0, Color& par_e1) {
+  Color lo{255.0F, 255.0F, 255.0F};
+  Color hi{0.0F, 0.0F, 0.0F};
+  Color mean{0.0F, 0.0F, 0.0F};
+  for (int i = 0; i < 16; i++) {
+    lo = {std::min(lo.r, par_block.r[i]), std::min(lo.g, par_block.g[i]),
+          std::min(lo.b, par_block.b[i])};
+    hi = {std::max(hi.r, par_block.r[i]), std::max(hi.g, par_block.g[i]),
+          std::max(hi.b, par_block.b[i])};
+    mean = {mean.r + par_block.r[i], mean.g + par_block.g[i], mean.b + par_block.b[i]};
+  }
+  mean = {mean.r / 16.0F, mean.g / 16.0F, mean.b / 16.0F};
+
+  // Pick the box diagonal that follows the colors, red is the reference axis.
+  float cov_rg = 0.0F;
+  float cov_rb = 0.0F;
+  for (int i = 0; i < 16; i++) {
+    cov_rg += (par_block.r[i] - mean.r) * (par_block.g[i] - mean.g);
+    cov_rb += (par_block.r[i] - mean.r) * (par_block.b[i] - mean.b);
+  }
+  if (cov_rg < 0.0F) {
+    std::swap(lo.g, hi.g);
+  }
+  if (cov_rb < 0.0F) {
+    std::swap(lo.b, hi.b);
+  }
+
+  // Inset the box a bit, the endpoints are rarely hit exactly.
+  par_e0 = mix(hi, lo, 1.0F / 16.0F);
+  par_e1 = mix(lo, hi, 1.0F / 16.0F);
+}
+
+void principal_axis_endpoints(const Block& par_block, Color& par_e0, Color& par_e1) {
+  Color mean{0.0F, 0.0F, 0.0F};
+  for (int i = 0; i < 16; i++) {
+    mean = {mean.r + par_block.r[i], mean.g + par_block.g[i], mean.b + par_block.b[i]};
+  }
+  mean = {mean.r / 16.0F, mean.g / 16.0F, mean.b / 16.0F};
+
+  float cov[6] = {};
+  for (int i = 0; i < 16; i++) {
+    const float r = par_block.r[i] - mean.r;
+    const float g = par_block.g[i] - mean.g;
+    const float b = par_block.b[i] - mean.b;
+    cov[0] += r * r;
+    cov[1] += r * g;
+    cov[2] += r * b;
+    cov[3] += g * g;
+    cov[4] += g * b;
+    cov[5] += b * b;
+  }
+
+  // Power iteration for the dominant eigenvector.
+  Color axis{1.0F, 1.0F, 1.0F};
+  for (int iter = 0; iter < 8; iter++) {
+    const Color next{axis.r * cov[0] + axis.g * cov[1] + axis.b * cov[2],
+                     axis.r * cov[1] + axis.g * cov[3] + axis.b * cov[4],
+                     axis.r * cov[2] + axis.g * cov[4] + axis.b * cov[5]};
+    const float len = std::max({std::fabs(next.r), std::fabs(next.g), std::fabs(next.b)});
+    if (len < 1e-6F) {
+      break;
+    }
+    axis = {next.r / len, next.g / len, next.b / len};
+  }
+
+  float min_proj = FLT_MAX;
+  float max_proj = -FLT_MAX;
+  int min_i = 0;
+  int max_i = 0;
+  for (int i = 0; i < 16; i++) {
+    const float proj = par_block.r[i] * axis.r + par_block.g[i] * axis.g + par_block.b[i] * axis.b;
+    if (proj < min_proj) {
+      min_proj = proj;
+      min_i = i;
+    }
+    if (proj > max_proj) {
+      max_proj = proj;
+      max_i = i;
+    }
+  }
+
+  par_e0 = {par_block.r[max_i], par_block.g[max_i], par_block.b[max_i]};
+  par_e1 = {par_block.r[min_i], par_block.g[min_i], par_block.b[min_i]};
+}
+
+struct ColorBlock {
+  std::uint16_t c0;
+  std::uint16_t c1;
+  std::uint8_t indices[16];
+  float error;
+};
+
+// Four color mode, c0 > c1.
+ColorBlock fit_four_colors(const Block& par_block, const Color& par_e0, const Color& par_e1) {
+  ColorBlock result{pack565(par_e0), pack565(par_e1), {}, 0.0F};
+  if (result.c0 < result.c1) {
+    std::swap(result.c0, result.c1);
+  }
+
+  const Color p0 = unpack565(result.c0);
+  const Color p1 = unpack565(result.c1);
+  if (result.c0 == result.c1) {
+    const Color palette[1] = {p0};
+    result.error = select_indices(par_block, palette, 1, result.indices);
+    return result;
+  }
+
+  const Color palette[4] = {p0, p1, mix(p0, p1, 1.0F / 3.0F), mix(p0, p1, 2.0F / 3.0F)};
+  result.error = select_indices(par_block, palette, 4, result.indices);
+  return result;
+}
+
+// Least squares fit of the endpoints to the current indices, see "Real-Time DXT Compression"
+// by J.M.P. van Waveren.
+bool refine_endpoints(const Block& par_block, const std::uint8_t* par_indices, Color& par_e0,
+                      Color& par_e1) {
+  static const float weights[4] = {0.0F, 1.0F, 1.0F / 3.0F, 2.0F / 3.0F};
+
+  float aa = 0.0F;
+  float ab = 0.0F;
+  float bb = 0.0F;
+  Color ap{0.0F, 0.0F, 0.0F};
+  Color bp{0.0F, 0.0F, 0.0F};
+  for (int i = 0; i < 16; i++) {
+    const float t = weights[par_indices[i]];
+    const float s = 1.0F - t;
+    aa += s * s;
+    ab += s * t;
+    bb += t * t;
+    ap = {ap.r + s * par_block.r[i], ap.g + s * par_block.g[i], ap.b + s * par_block.b[i]};
+    bp = {bp.r + t * par_block.r[i], bp.g + t * par_block.g[i], bp.b + t * par_block.b[i]};
+  }
+
+  const float det = aa * bb - ab * ab;
+  if (std::fabs(det) < 1e-6F) {
+    return false;
+  }
+
+  const float inv = 1.0F / det;
+  par_e0 = {(ap.r * bb - bp.r * ab) * inv, (ap.g * bb - bp.g * ab) * inv,
+            (ap.b * bb - bp.b * ab) * inv};
+  par_e1 = {(bp.r * aa - ap.r * ab) * inv, (bp.g * aa - ap.g * ab) * inv,
+            (bp.b * aa - ap.b * ab) * inv};
+  return true;
+}
+
+void write_color_block(const ColorBlock& par_block, std::uint8_t* par_out) {
+  std::uint32_t bits = 0;
+  for (int i = 0; i < 16; i++) {
+    bits |= static_cast<std::uint32_t>(par_block.indices[i]) << (2 * i);
+  }
+
+  par_out[0] = par_block.c0 & 0xFF;
+  par_out[1] = par_block.c0 >> 8;
+  par_out[2] = par_block.c1 & 0xFF;
+  par_out[3] = par_block.c1 >> 8;
+  for (int i = 0; i < 4; i++) {
+    par_out[4 + i] = (bits >> (8 * i)) & 0xFF;
+  }
+}
+
+void encode_color(const Block& par_block, bool par_punch_through, Quality par_quality,
+                  std::uint8_t* par_out) {
+  Color e0;
+  Color e1;
+  if (par_quality == Quality::Fast) {
+    bounding_box_endpoints(par_block, e0, e1);
+  } else {
+    principal_axis_endpoints(par_block, e0, e1);
+  }
+
+  if (par_punch_through) {
+    // Three color mode (c0 <= c1), index 3 is transparent black.
+    ColorBlock result{pack565(e0), pack565(e1), {}, 0.0F};
+    if (result.c0 > result.c1) {
+      std::swap(result.c0, result.c1);
+    }
+
+    const Color p0 = unpack565(result.c0);
+    const Color p1 = unpack565(result.c1);
+    const Color palette[3] = {p0, p1, mix(p0, p1, 0.5F)};
+    select_indices(par_block, palette, 3, result.indices);
+    for (int i = 0; i < 16; i++) {
+      if (par_block.a[i] < 128) {
+        result.indices[i] = 3;
+      }
+    }
+
+    write_color_block(result, par_out);
+    return;
+  }
+
+  ColorBlock best = fit_four_colors(par_block, e0, e1);
+
+  if (par_quality == Quality::High) {
+    for (int iter = 0; iter < 2 && best.error > 0.0F; iter++) {
+      // The refinement works on the endpoints as they are stored, c0 is the first weight.
+      Color r0;
+      Color r1;
+      if (!refine_endpoints(par_block, best.indices, r0, r1)) {
+        break;
+      }
+
+      const ColorBlock refined = fit_four_colors(par_block, r0, r1);
+      if (refined.error >= best.error) {
+        break;
+      }
+      best = refined;
+    }
+  }
+
+  write_color_block(best, par_out);
+}
+
+// Fits a BC3 alpha block, par_six selects the 6 alpha + 0/255 mode.
+float fit_alpha(const std::uint8_t* par_alpha, bool par_six, std::uint8_t& par_a0,
+                std::uint8_t& par_a1, std::uint8_t* par_indices) {
+  int lo = 255;
+  int hi = 0;
+  for (int i = 0; i < 16; i++) {
+    const int a = par_alpha[i];
+    if (par_six && (a == 0 || a == 255)) {
+      continue;
+    }
+    lo = std::min(lo, a);
+    hi = std::max(hi, a);
+  }
+  if (lo > hi) {
+    // Only 0 and 255 in the block.
+    lo = hi = 0;
+  }
+
+  int palette[8];
+  if (par_six) {
+    par_a0 = static_cast<std::uint8_t>(lo);
+    par_a1 = static_cast<std::uint8_t>(hi);
+    palette[0] = lo;
+    palette[1] = hi;
+    for (int j = 2; j < 6; j++) {
+      palette[j] = ((6 - j) * lo + (j - 1) * hi) / 5;
+    }
+    palette[6] = 0;
+    palette[7] = 255;
+  } else {
+    par_a0 = static_cast<std::uint8_t>(hi);
+    par_a1 = static_cast<std::uint8_t>(lo);
+    palette[0] = hi;
+    palette[1] = lo;
+    for (int j = 2; j < 8; j++) {
+      palette[j] = ((8 - j) * hi + (j - 1) * lo) / 7;
+    }
+  }
+
+  float error = 0.0F;
+  for (int i = 0; i < 16; i++) {
+    int best = 256 * 256;
+    for (int k = 0; k < 8; k++) {
+      const int diff = palette[k] - par_alpha[i];
+      if (diff * diff < best) {
+        best = diff * diff;
+        par_indices[i] = static_cast<std::uint8_t>(k);
+      }
+    }
+    error += static_cast<float>(best);
+  }
+
+  return error;
+}
+
+void encode_alpha(const Block& par_block, Quality par_quality, std::uint8_t* par_out) {
+  std::uint8_t a0 = 0;
+  std::uint8_t a1 = 0;
+  std::uint8_t indices[16];
+  float error = fit_alpha(par_block.a, false, a0, a1, indices);
+
+  if (par_quality == Quality::High && error > 0.0F) {
+    std::uint8_t six_a0 = 0;
+    std::uint8_t six_a1 = 0;
+    std::uint8_t six_indices[16];
+    if (fit_alpha(par_block.a, true, six_a0, six_a1, six_indices) < error) {
+      a0 = six_a0;
+      a1 = six_a1;
+      std::memcpy(indices, six_indices, sizeof(indices));
+    }
+  }
+
+  std::uint64_t bits = 0;
+  for (int i = 0; i < 16; i++) {
+    bits |= static_cast<std::uint64_t>(indices[i]) << (3 * i);
+  }
+
+  par_out[0] = a0;
+  par_out[1] = a1;
+  for (int i = 0; i < 6; i++) {
+    par_out[2 + i] = (bits >> (8 * i)) & 0xFF;
+  }
+}
+
+int block_count(int par_size) { return std::max(1, (par_size + 3) / 4); }
+
+std::size_t block_size(Format par_format) { return par_format == Format::BC1 ? 8 : 16; }
+
+}  // namespace
+
+std::size_t compressed_size(int par_width, int par_height, Format par_format) {
+  return static_cast<std::size_t>(block_count(par_width)) * block_count(par_height) *
+         block_size(par_format);
+}
+
+std::vector<std::uint8_t> compress(const Level& par_level, Format par_format,
+                                   Quality par_quality) {
+  const int blocks_x = block_count(par_level.width);
+  const int blocks_y = block_count(par_level.height);
+  const std::size_t row_size = blocks_x * block_size(par_format);
+
+  std::vector<std::uint8_t> result(compressed_size(par_level.width, par_level.height, par_format));
+
+  ups::parallel_for(blocks_y, [&](std::size_t par_by) {
+    Block block;
+    std::uint8_t* out = result.data() + par_by * row_size;
+
+    for (int bx = 0; bx < blocks_x; bx++) {
+      load_block(par_level, bx, static_cast<int>(par_by), block);
+
+      if (par_format == Format::BC3) {
+        encode_alpha(block, par_quality, out);
+        encode_color(block, false, par_quality, out + 8);
+        out += 16;
+      } else {
+        const bool punch_through =
+            std::any_of(std::begin(block.a), std::end(block.a), [](auto a) { return a < 128; });
+        encode_color(block, punch_through, par_quality, out);
+        out += 8;
+      }
+    }
+  });
+
+  return result;
+}
+
+namespace {
+
+bool write_header(FILE* par_fp, int par_width, int par_height, std::size_t par_levels,
+                  Format par_format) {
+  nv_dds::DDS_HEADER header{};
+  header.dwSize = sizeof(nv_dds::DDS_HEADER);
+  header.dwFlags = nv_dds::DDSF_CAPS | nv_dds::DDSF_WIDTH | nv_dds::DDSF_HEIGHT |
+                   nv_dds::DDSF_PIXELFORMAT | nv_dds::DDSF_LINEARSIZE;
+  header.dwWidth = par_width;
+  header.dwHeight = par_height;
+  header.dwPitchOrLinearSize = compressed_size(par_width, par_height, par_format);
+  header.ddspf.dwSize = sizeof(nv_dds::DDS_PIXELFORMAT);
+  header.ddspf.dwFlags = nv_dds::DDSF_FOURCC;
+  header.ddspf.dwFourCC = par_format == Format::BC1 ? nv_dds::FOURCC_DXT1 : nv_dds::FOURCC_DXT5;
+  header.dwCaps1 = nv_dds::DDSF_TEXTURE;
+
+  if (par_levels > 1) {
+    header.dwFlags |= nv_dds::DDSF_MIPMAPCOUNT;
+    header.dwMipMapCount = par_levels;
+    header.dwCaps1 |= nv_dds::DDSF_COMPLEX | nv_dds::DDSF_MIPMAP;
+  }
+
+  return fwrite("DDS ", 1, 4, par_fp) == 4 &&
+         fwrite(&header, sizeof(nv_dds::DDS_HEADER), 1, par_fp) == 1;
+}
+
+// Rows get compressed in batches of this many, a multiple of the block height.
+constexpr int kFlushRows = 256;
+
+// Adds par_row, box filtered down to half its width (at least 1) and scaled by par_weight, to
+// par_sum. Color channels are summed in linear space. On odd widths a destination pixel covers
+// 2 + 1 / width source pixels, which get weighted by how much of them it covers.
+void accumulate_row(const std::uint8_t* par_row, int par_width, int par_channels,
+                    float par_weight, float* par_sum) {
+  const ups::ColorTables& srgb = ups::color_tables(true);
+  const ups::ColorTables& linear = ups::color_tables(false);
+  const int width = std::max(1, par_width / 2);
+
+  // Destination pixel x covers [x * par_width, (x + 1) * par_width) and source pixel i covers
+  // [i * width, (i + 1) * width), both in units of 1 / (par_width * width) pixels.
+  for (int x = 0; x < width; x++) {
+    const int begin = x * par_width;
+    const int end = begin + par_width;
+    float* sum = par_sum + x * par_channels;
+
+    for (int i = begin / width; i < par_width && i * width < end; i++) {
+      const int overlap = std::min(end, (i + 1) * width) - std::max(begin, i * width);
+      const float weight = par_weight * static_cast<float>(overlap) / par_width;
+      const std::uint8_t* pixel = par_row + i * par_channels;
+      for (int c = 0; c < par_channels; c++) {
+        sum[c] += (c == 3 ? linear : srgb).to_linear[pixel[c]] * weight;
+      }
+    }
+  }
+}
+
+// Converts par_width pixels of linear sums back to 8 bit.
+void store_row(const float* par_sum, int par_width, int par_channels, std::uint8_t* par_out) {
+  const ups::ColorTables& srgb = ups::color_tables(true);
+  const ups::ColorTables& linear = ups::color_tables(false);
+
+  for (int i = 0; i < par_width * par_channels; i++) {
+    const float value = std::clamp(par_sum[i], 0.0F, 1.0F);
+    par_out[i] = (i % par_channels == 3 ? linear : srgb)
+                     .from_linear[static_cast<int>(value * (ups::kLinearTableSize - 1) + 0.5F)];
+  }
+}
+
+}  // namespace
+
+bool save_dds(const std::string& par_file, const std::vector<Level>& par_levels,
+              Format par_format, Quality par_quality) {
+  if (par_levels.empty()) {
+    return false;
+  }
+
+  FILE* fp = fopen(par_file.c_str(), "wb");
+  if (fp == nullptr) {
+    spdlog::error("Failed to open '{}' for writing", par_file);
+    return false;
+  }
+
+  const Level& base = par_levels.front();
+  bool result = write_header(fp, base.width, base.height, par_levels.size(), par_format);
+
+  for (const auto& level : par_levels) {
+    if (!result) {
+      break;
+    }
+
+    const auto blocks = compress(level, par_format, par_quality);
+    result = fwrite(blocks.data(), 1, blocks.size(), fp) == blocks.size();
+  }
+
+  fclose(fp);
+
+  if (!result) {
+    spdlog::error("Failed to write '{}'", par_file);
+  }
+
+  return result;
+}
+
+// ------------------------------------------------------------------------------------------------
+// DdsWriter
+// ------------------------------------------------------------------------------------------------
+
+DdsWriter::~DdsWriter() {
+  if (fp_ != nullptr) {
+    fclose(fp_);
+  }
+}
+
+bool DdsWriter::open(const std::string& par_file, int par_width, int par_height,
+                     int par_channels, Format par_format, Quality par_quality, bool par_mipmaps) {
+  if (fp_ != nullptr || par_width < 1 || par_height < 1 || par_channels < 3 ||
+      par_channels > 4) {
+    return false;
+  }
+
+  file_ = par_file;
+  format_ = par_format;
+  quality_ = par_quality;
+  channels_ = par_channels;
+
+  levels_.clear();
+  long offset = 4 + sizeof(nv_dds::DDS_HEADER);
+  int width = par_width;
+  int height = par_height;
+  for (;;) {
+    levels_.push_back({width, height, offset, 0, 0, {}, {}});
+    offset += static_cast<long>(compressed_size(width, height, format_));
+
+    if (!par_mipmaps || (width == 1 && height == 1)) {
+      break;
+    }
+    width = std::max(1, width / 2);
+    height = std::max(1, height / 2);
+  }
+
+  fp_ = fopen(par_file.c_str(), "wb");
+  if (fp_ == nullptr) {
+    spdlog::error("Failed to open '{}' for writing", par_file);
+    return false;
+  }
+
+  if (!write_header(fp_, par_width, par_height, levels_.size(), format_)) {
+    spdlog::error("Failed to write '{}'", file_);
+    return false;
+  }
+
+  return true;
+}
+
+bool DdsWriter::write_rows(const std::uint8_t* par_rows, int par_count) {
+  if (fp_ == nullptr || levels_.front().rows_received + par_count > levels_.front().height) {
+    return false;
+  }
+
+  return push_rows_(0, par_rows, par_count);
+}
+
+bool DdsWriter::close() {
+  if (fp_ == nullptr) {
+    return false;
+  }
+
+  const bool complete = std::all_of(levels_.begin(), levels_.end(), [](const auto& par_level) {
+    return par_level.rows_written == par_level.height;
+  });
+
+  fclose(fp_);
+  fp_ = nullptr;
+
+  if (!complete) {
+    spdlog::error("'{}' is incomplete", file_);
+  }
+
+  return complete;
+}
+
+bool DdsWriter::push_rows_(std::size_t par_level, const std::uint8_t* par_rows, int par_count) {
+  LevelState& level = levels_[par_level];
+  const std::size_t row_size = static_cast<std::size_t>(level.width) * channels_;
+
+  for (int i = 0; i < par_count; i++) {
+    const std::uint8_t* row = par_rows + i * row_size;
+    level.pending.insert(level.pending.end(), row, row + row_size);
+
+    // Row y covers [y * next.height, (y + 1) * next.height) and row d of the next level covers
+    // [d * height, (d + 1) * height), in units of 1 / (height * next.height) rows. On odd
+    // heights a row can straddle two rows of the next level, carry sums the one in progress.
+    const int y = level.rows_received++;
+    if (par_level + 1 < levels_.size()) {
+      const LevelState& next = levels_[par_level + 1];
+      const std::int64_t begin = static_cast<std::int64_t>(y) * next.height;
+      const std::int64_t end = begin + next.height;
+      level.carry.resize(static_cast<std::size_t>(next.width) * channels_, 0.0F);
+
+      while (next.rows_received < next.height) {
+        const std::int64_t row_begin = static_cast<std::int64_t>(next.rows_received) * level.height;
+        const std::int64_t row_end = row_begin + level.height;
+        const std::int64_t overlap = std::min(end, row_end) - std::max(begin, row_begin);
+        if (overlap > 0) {
+          accumulate_row(row, level.width, channels_,
+                         static_cast<float>(overlap) / static_cast<float>(level.height),
+                         level.carry.data());
+        }
+        if (row_end > end) {
+          break;
+        }
+
+        std::vector<std::uint8_t> out(level.carry.size());
+        store_row(level.carry.data(), next.width, channels_, out.data());
+        std::fill(level.carry.begin(), level.carry.end(), 0.0F);
+        if (!push_rows_(par_level + 1, out.data(), 1)) {
+          return false;
+        }
+      }
+    }
+
+    if (level.pending.size() >= kFlushRows * row_size || level.rows_received == level.height) {
+      if (!flush_(par_level)) {
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+bool DdsWriter::flush_(std::size_t par_level) {
+  LevelState& level = levels_[par_level];
+  const std::size_t row_size = static_cast<std::size_t>(level.width) * channels_;
+
+  int rows = static_cast<int>(level.pending.size() / row_size);
+  if (level.rows_written + rows < level.height) {
+    // Only whole blocks, the rest waits for the next rows.
+    rows -= rows % 4;
+  }
+  if (rows == 0) {
+    return true;
+  }
+
+  const Level view{level.width, rows, channels_, level.pending.data(),
+                   static_cast<std::ptrdiff_t>(row_size)};
+  const auto blocks = compress(view, format_, quality_);
+
+  const long offset = level.offset + static_cast<long>(compressed_size(level.width, 4, format_)) *
+                                         (level.rows_written / 4);
+  if (fseek(fp_, offset, SEEK_SET) != 0 ||
+      fwrite(blocks.data(), 1, blocks.size(), fp_) != blocks.size()) {
+    spdlog::error("Failed to write '{}'", file_);
+    return false;
+  }
+
+  level.pending.erase(level.pending.begin(), level.pending.begin() + rows * row_size);
+  level.rows_written += rows;
+
+  return true;
+}
+
+}  // namespace dxt
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdio>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * BC1 (DXT1) and BC3 (DXT5) block compression and DDS writing.
+ *
+ * Blocks are compressed in parallel over all cores, the inner loops use SSE2 when available.
+ */
+namespace dxt {
+
+enum class Format {
+  BC1,  // DXT1, RGB + 1 bit alpha, 8 bytes per block
+  BC3   // DXT5, RGB + interpolated alpha, 16 bytes per block
+};
+
+enum class Quality {
+  Fast,    // bounding box endpoints
+  Normal,  // principal axis endpoints
+  High     // principal axis endpoints refined by least squares, both BC3 alpha modes
+};
+
+/**
+ * A view on RGB8/RGBA8 pixels, row 0 is the first row written to the file.
+ * Use a negative pitch to read the rows bottom up.
+ */
+struct Level {
+  int width;
+  int height;
+  int channels;
+  const std::uint8_t* rgba;
+  std::ptrdiff_t pitch;
+};
+
+std::size_t compressed_size(int par_width, int par_height, Format par_format);
+
+std::vector<std::uint8_t> compress(const Level& par_level, Format par_format,
+                                   Quality par_quality);
+
+/**
+ * Compresses par_levels (the base level followed by its mipmaps) and writes them as DDS file.
+ */
+bool save_dds(const std::string& par_file, const std::vector<Level>& par_levels,
+              Format par_format, Quality par_quality);
+
+/**
+ * Writes a DDS file row by row (top row first), so the image never has to be in memory as a
+ * whole. The mipmaps get generated on the fly with a gamma correct box filter.
+ */
+class DdsWriter {
+ public:
+  DdsWriter() = default;
+  ~DdsWriter();
+
+  DdsWriter(const DdsWriter& rhs) = delete;
+  DdsWriter& operator=(const DdsWriter& rhs) = delete;
+
+  bool open(const std::string& par_file, int par_width, int par_height, int par_channels,
+            Format par_format, Quality par_quality, bool par_mipmaps = true);
+
+  // par_count rows of width * channels bytes each.
+  bool write_rows(const std::uint8_t* par_rows, int par_count);
+
+  // Fails if not all rows got written.
+  bool close();
+
+ private:
+  struct LevelState {
+    int width;
+    int height;
+    long offset;         // of the level in the file
+    int rows_received;   // rows pushed into this level so far
+    int rows_written;    // rows compressed and written
+    std::vector<std::uint8_t> pending;  // received rows which aren't compressed yet
+    std::vector<float> carry;           // linear sum of the next level's unfinished row
+  };
+
+  bool push_rows_(std::size_t par_level, const std::uint8_t* par_rows, int par_count);
+  bool flush_(std::size_t par_level);
+
+  FILE* fp_ = nullptr;
+  std::string file_;
+  Format format_ = Format::BC1;
+  Quality quality_ = Quality::Normal;
+  int channels_ = 0;
+  std::vector<LevelState> levels_;
+};
+
+}  // namespace dxt
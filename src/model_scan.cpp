@@ -0,0 +1,326 @@
+#include "model_scan.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <unordered_map>
+
+#include "EditorIncl.h"
+#include "EditorDef.h"
+#include "Model.h"
+#include "parallel.h"
+#include "string_util.h"
+#include "FileIO/TAPalette.h"
+#include "FileSystem/CPrefetchReader.h"
+#include "FileSystem/CVirtualFileSystem.h"
+
+#include "spdlog/spdlog.h"
+#include "spdlog/sinks/stdout_color_sinks.h"
+
+namespace ups {
+
+namespace {
+
+// Fewer than 3 corners, a repeated or invalid corner, or no area.
+bool is_degenerate(const PolyMesh& par_mesh, const Poly& par_poly) {
+  const auto& verts = par_poly.verts;
+  if (verts.size() < 3) {
+    return true;
+  }
+
+  for (std::size_t i = 0; i < verts.size(); i++) {
+    if (verts[i] < 0 || static_cast<std::size_t>(verts[i]) >= par_mesh.verts.size()) {
+      return true;
+    }
+    for (std::size_t j = i + 1; j < verts.size(); j++) {
+      if (verts[i] == verts[j]) {
+        return true;
+      }
+    }
+  }
+
+  // Newell's method, twice the area vector.
+  Vector3 normal;
+  for (std::size_t i = 0; i < verts.size(); i++) {
+    const Vector3& a = par_mesh.verts[verts[i]].pos;
+    const Vector3& b = par_mesh.verts[verts[(i + 1) % verts.size()]].pos;
+    normal += a.crossproduct(b);
+  }
+  return normal.length() < 1e-8F;
+}
+
+void collect_stats(const MdlObject* par_obj, std::size_t par_depth, model_stats& par_stats,
+                   std::set<std::string>& par_textures) {
+  par_stats.pieces++;
+  par_stats.max_depth = std::max(par_stats.max_depth, par_depth);
+
+  const PolyMesh* mesh = par_obj->GetPolyMesh();
+  if (mesh != nullptr) {
+    par_stats.vertices += mesh->verts.size();
+    par_stats.polygons += mesh->poly.size();
+    for (const Poly* poly : mesh->poly) {
+      if (poly->verts.size() >= 3) {
+        par_stats.triangles += poly->verts.size() - 2;
+      }
+      if (is_degenerate(*mesh, *poly)) {
+        par_stats.degenerate_polygons++;
+      }
+      if (!poly->texname.empty()) {
+        par_textures.insert(poly->texname);
+      }
+    }
+  }
+
+  for (const MdlObject* child : par_obj->childs) {
+    collect_stats(child, par_depth + 1, par_stats, par_textures);
+  }
+}
+
+std::string csv_field(const std::string& par_value) {
+  if (par_value.find_first_of(",\"\r\n") == std::string::npos) {
+    return par_value;
+  }
+
+  std::string result = "\"";
+  for (const char c : par_value) {
+    if (c == '"') {
+      result += '"';
+    }
+    result += c;
+  }
+  return result + "\"";
+}
+
+std::string json_string(const std::string& par_value) {
+  std::string result = "\"";
+  for (const char c : par_value) {
+    switch (c) {
+      case '"':
+        result += "\\\"";
+        break;
+      case '\\':
+        result += "\\\\";
+        break;
+      case '\n':
+        result += "\\n";
+        break;
+      case '\r':
+        result += "\\r";
+        break;
+      case '\t':
+        result += "\\t";
+        break;
+      default:
+        if (static_cast<unsigned char>(c) < 0x20) {
+          result += SPrintf("\\u%04x", static_cast<unsigned char>(c));
+        } else {
+          result += c;
+        }
+    }
+  }
+  return result + "\"";
+}
+
+void write_json_model(std::ostream& par_out, const model_stats& par_stats) {
+  par_out << "{\"file\": " << json_string(par_stats.file)
+          << ", \"ok\": " << (par_stats.ok ? "true" : "false");
+  if (!par_stats.ok) {
+    par_out << ", \"error\": " << json_string(par_stats.error);
+  }
+  par_out << ", \"bytes\": " << par_stats.bytes << ", \"load_ms\": " << par_stats.load_ms
+          << ", \"pieces\": " << par_stats.pieces << ", \"max_depth\": " << par_stats.max_depth
+          << ", \"vertices\": " << par_stats.vertices << ", \"polygons\": " << par_stats.polygons
+          << ", \"triangles\": " << par_stats.triangles
+          << ", \"degenerate_polygons\": " << par_stats.degenerate_polygons << ", \"textures\": [";
+  for (std::size_t i = 0; i < par_stats.textures.size(); i++) {
+    par_out << (i > 0 ? ", " : "") << json_string(par_stats.textures[i]);
+  }
+  par_out << "]}";
+}
+
+}  // namespace
+
+bool scan_models(const CVirtualFileSystem& par_vfs, const std::string& par_prefix,
+                 std::vector<model_stats>& par_stats) {
+  const auto prefix = CVirtualFileSystem::NormalizePath(par_prefix);
+
+  par_stats.clear();
+  std::vector<std::size_t> indices;
+  bool has_3do = false;
+  for (std::size_t i = 0; i < par_vfs.NumFiles(); i++) {
+    const auto& name = par_vfs.File(i).name;
+    const auto ext = std::filesystem::path(name).extension().string();
+    if (name.rfind(prefix, 0) != 0 || (ext != ".3do" && ext != ".s3o")) {
+      continue;
+    }
+    indices.push_back(i);
+    has_3do = has_3do || ext == ".3do";
+  }
+
+  // Loaded lazily otherwise, which isn't safe from the workers. Without it every worker would
+  // retry the load.
+  auto& palette = GetTAPalette();
+  if (has_3do && !palette.loaded) {
+    palette.Init();
+    if (palette.error) {
+      spdlog::error("Can't scan .3do models without the TA palette");
+      return false;
+    }
+  }
+
+  // Files() is in mount order, the results are sorted by name.
+  std::sort(indices.begin(), indices.end(), [&par_vfs](std::size_t par_a, std::size_t par_b) {
+    return par_vfs.File(par_a).name < par_vfs.File(par_b).name;
+  });
+  std::unordered_map<std::size_t, std::size_t> slots;
+  par_stats.resize(indices.size());
+  for (std::size_t i = 0; i < indices.size(); i++) {
+    slots[indices[i]] = i;
+    par_stats[i].file = par_vfs.File(indices[i]).name;
+  }
+
+  CPrefetchReader reader(par_vfs, 2 * worker_count());
+  reader.Submit(indices);
+  reader.Close();
+
+  // Every worker takes the next file that was read.
+  parallel_for(worker_count(), [&](std::size_t /*par_worker*/) {
+    CPrefetchReader::File file;
+    while (reader.Next(file)) {
+      auto& stats = par_stats[slots.at(file.fid)];
+      stats.bytes = file.data.size();
+      if (!file.ok) {
+        stats.error = "failed to read the file";
+        continue;
+      }
+
+      const auto start = std::chrono::steady_clock::now();
+      Model* mdl = Model::load_from_memory(file.data, stats.file, &stats.error);
+      const auto end = std::chrono::steady_clock::now();
+      stats.load_ms = std::chrono::duration<double, std::milli>(end - start).count();
+      if (mdl == nullptr) {
+        continue;
+      }
+
+      std::set<std::string> textures;
+      if (mdl->root != nullptr) {
+        collect_stats(mdl->root, 0, stats, textures);
+      }
+      for (const auto& binding : mdl->texBindings) {
+        if (!binding.name.empty()) {
+          textures.insert(binding.name);
+        }
+      }
+      stats.textures.assign(textures.begin(), textures.end());
+      stats.ok = true;
+
+      delete mdl;
+    }
+  });
+
+  return true;
+}
+
+std::vector<const model_stats*> slowest_models(const std::vector<model_stats>& par_stats,
+                                               std::size_t par_count) {
+  std::vector<const model_stats*> result;
+  result.reserve(par_stats.size());
+  for (const auto& stats : par_stats) {
+    result.push_back(&stats);
+  }
+
+  const auto count = std::min(par_count, result.size());
+  std::partial_sort(result.begin(), result.begin() + count, result.end(),
+                    [](const auto* par_a, const auto* par_b) {
+                      return par_a->load_ms > par_b->load_ms;
+                    });
+  result.resize(count);
+  return result;
+}
+
+void write_model_stats_csv(std::ostream& par_out, const std::vector<model_stats>& par_stats) {
+  par_out << "file,ok,error,bytes,load_ms,pieces,max_depth,vertices,polygons,triangles,"
+             "degenerate_polygons,textures\n";
+  for (const auto& stats : par_stats) {
+    std::string textures;
+    for (const auto& texture : stats.textures) {
+      textures += (textures.empty() ? "" : ";") + texture;
+    }
+
+    par_out << csv_field(stats.file) << ',' << (stats.ok ? 1 : 0) << ',' << csv_field(stats.error)
+            << ',' << stats.bytes << ',' << stats.load_ms << ',' << stats.pieces << ','
+            << stats.max_depth << ',' << stats.vertices << ',' << stats.polygons << ','
+            << stats.triangles << ',' << stats.degenerate_polygons << ',' << csv_field(textures)
+            << '\n';
+  }
+}
+
+void write_model_stats_json(std::ostream& par_out, const std::vector<model_stats>& par_stats,
+                            std::size_t par_slowest) {
+  par_out << "{\n  \"models\": [";
+  for (std::size_t i = 0; i < par_stats.size(); i++) {
+    par_out << (i > 0 ? ",\n    " : "\n    ");
+    write_json_model(par_out, par_stats[i]);
+  }
+  par_out << "\n  ],\n  \"slowest\": [";
+
+  const auto slowest = slowest_models(par_stats, par_slowest);
+  for (std::size_t i = 0; i < slowest.size(); i++) {
+    par_out << (i > 0 ? ", " : "") << json_string(slowest[i]->file);
+  }
+  par_out << "]\n}\n";
+}
+
+int run_model_scan(const std::string& par_archive, const std::string& par_prefix,
+                   const std::string& par_format, const std::string& par_output,
+                   std::size_t par_slowest) {
+  // Keep stdout clean for the statistics.
+  if (par_output.empty()) {
+    spdlog::set_default_logger(spdlog::stderr_color_mt("scan"));
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+
+  CVirtualFileSystem vfs;
+  const std::vector<std::string> prefixes = {CVirtualFileSystem::NormalizePath(par_prefix)};
+  if (!vfs.Mount(par_archive, par_prefix.empty() ? std::vector<std::string>() : prefixes)) {
+    spdlog::error("Failed to open the archive '{}'", par_archive);
+    return 1;
+  }
+
+  std::vector<model_stats> stats;
+  if (!scan_models(vfs, par_prefix, stats)) {
+    return 1;
+  }
+
+  const auto end = std::chrono::steady_clock::now();
+  const auto failed = std::count_if(stats.begin(), stats.end(),
+                                    [](const model_stats& par_stats) { return !par_stats.ok; });
+  spdlog::info("Scanned {} models in {:.1f}ms, {} failed to load", stats.size(),
+               std::chrono::duration<double, std::milli>(end - start).count(), failed);
+  for (const auto* slow : slowest_models(stats, par_slowest)) {
+    spdlog::info("  {:8.2f}ms {}", slow->load_ms, slow->file);
+  }
+
+  std::ofstream file;
+  if (!par_output.empty()) {
+    file.open(par_output);
+    if (!file.is_open()) {
+      spdlog::error("Failed to write '{}'", par_output);
+      return 1;
+    }
+  }
+  std::ostream& out = par_output.empty() ? std::cout : file;
+
+  if (par_format == "json") {
+    write_model_stats_json(out, stats, par_slowest);
+  } else {
+    write_model_stats_csv(out, stats);
+  }
+
+  return out.good() ? 0 : 1;
+}
+
+};  // namespace ups
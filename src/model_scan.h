@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <vector>
+
+class CVirtualFileSystem;
+
+namespace ups {
+
+struct model_stats {
+  std::string file;
+  bool ok = false;
+  std::string error;
+
+  std::size_t bytes = 0;
+  double load_ms = 0.0;  // parsing only, reading happens in bulk ahead of it
+
+  std::size_t pieces = 0;
+  std::size_t max_depth = 0;  // the root piece is depth 0
+  std::size_t vertices = 0;
+  std::size_t polygons = 0;
+  std::size_t triangles = 0;  // after fanning every polygon
+  std::size_t degenerate_polygons = 0;
+  std::vector<std::string> textures;  // sorted, unique
+};
+
+/**
+ * Loads every .3do and .s3o below par_prefix with the regular loaders, on all cores, and collects
+ * per model statistics into par_stats, in file name order. Fails without loading anything when
+ * there are .3do files but the TA palette can't be loaded.
+ */
+bool scan_models(const CVirtualFileSystem& par_vfs, const std::string& par_prefix,
+                 std::vector<model_stats>& par_stats);
+
+// The par_count slowest models to load, slowest first.
+std::vector<const model_stats*> slowest_models(const std::vector<model_stats>& par_stats,
+                                               std::size_t par_count);
+
+void write_model_stats_csv(std::ostream& par_out, const std::vector<model_stats>& par_stats);
+void write_model_stats_json(std::ostream& par_out, const std::vector<model_stats>& par_stats,
+                            std::size_t par_slowest);
+
+/**
+ * The --scan-models command: scans par_archive, writes the statistics as par_format ("csv" or
+ * "json") to par_output, stdout if empty, and logs the par_slowest slowest models.
+ * @return the process exit code
+ */
+int run_model_scan(const std::string& par_archive, const std::string& par_prefix,
+                   const std::string& par_format, const std::string& par_output,
+                   std::size_t par_slowest);
+
+};  // namespace ups
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+namespace ups {
+
+// Number of threads parallel_for spreads its work over.
+inline std::size_t worker_count() {
+  return std::max<std::size_t>(1, std::thread::hardware_concurrency());
+}
+
+/**
+ * Calls par_fn(i) for every i in [0, par_count), the indices get handed out one by one to
+ * worker_count() threads, the calling thread is one of them.
+ */
+template <typename Fn>
+void parallel_for(std::size_t par_count, Fn&& par_fn) {
+  const std::size_t workers = std::min(worker_count(), par_count);
+  if (workers <= 1) {
+    for (std::size_t i = 0; i < par_count; i++) {
+      par_fn(i);
+    }
+    return;
+  }
+
+  std::atomic<std::size_t> next{0};
+  auto work = [&next, &par_fn, par_count]() {
+    for (std::size_t i = next++; i < par_count; i = next++) {
+      par_fn(i);
+    }
+  };
+
+  std::vector<std::thread> threads;
+  threads.reserve(workers - 1);
+  for (std::size_t i = 1; i < workers; i++) {
+    threads.emplace_back(work);
+  }
+
+  work();
+
+  for (auto& thread : threads) {
+    thread.join();
+  }
+}
+
+};  // namespace ups
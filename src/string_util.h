@@ -43,7 +43,7 @@ inline std::string join(const std::vector<std::string> alist) {
              std::accumulate( /* otherwise, accumulate */
                              ++alist.begin(), alist.end(), /* the range 2nd to after-last */
                              *alist.begin(), /* and start accumulating with the first item */
-                             [](auto& a, auto& b) { return a + "," + b; });
+                             [](const auto& a, const auto& b) { return a + "," + b; });
 }
 
 #if defined(_WIN32)
@@ -67,6 +67,12 @@ namespace std {
 %include "../Animation.h"
 %include "../IEditor.h"
 %include "ScriptInterface.h"
+// Compression presets of Image::save() and atlas::save(), upspring.Quality_Fast, Quality_Normal
+// and Quality_High in Lua.
+namespace dxt {
+enum class Quality { Fast, Normal, High };
+}
+
 %include "../Image.h"
 %include "../Texture.h"
 %include "../Atlas/atlas.hpp"
@@ -116,33 +122,57 @@ inline %{
 
 namespace UpsScript {
 	auto textureHandler = std::make_shared<TextureHandler>();
+	auto vfs = std::make_shared<CVirtualFileSystem>();
 
 	std::shared_ptr<TextureHandler> get_texture_handler() {
 		return textureHandler;
 	}
 
+	// Files in an archive mounted later hide the ones mounted before.
+	bool mount_archive(const std::string &pArchive) {
+		return vfs->Mount(pArchive);
+	}
+
+	bool file_exists(const std::string &pPath) {
+		return vfs->FileExists(pPath);
+	}
+
+	// Empty if no mounted archive has pPath.
+	std::string read_file(const std::string &pPath) {
+		std::vector<std::uint8_t> buffer;
+		if (!vfs->GetFile(pPath, buffer)) {
+			return std::string();
+		}
+		return std::string(buffer.begin(), buffer.end());
+	}
+
+	// Textures the new archive overrides get replaced, so they match read_file().
 	void load_archive(const std::string &pArchive) {
 		std::cout << "Loading 3DO textures from archive: " << pArchive << std::endl;
-		textureHandler->Load3DO(pArchive);
+		mount_archive(pArchive);
+		textureHandler->Load3DO(*vfs, true);
 	}
 
 	void load_archives() {
 		ArchiveList archives;
 		archives.Load();
 
-		for (auto it = archives.archives.begin(); it !=archives.archives.end(); ++it) {
-			load_archive(*it);
+		// The first listed archive wins, like in the editor.
+		for (auto it = archives.archives.rbegin(); it != archives.archives.rend(); ++it) {
+			mount_archive(*it);
 		}
+		textureHandler->Load3DO(*vfs);
 	};
 
 	void textures_to_model(Model *pModel) {
 		pModel->load_3do_textures(textureHandler);
 	}
 
-	void make_archive_atlas(const std::string &archive_par, const std::string &par_savepath, bool par_power_of_two) {
+	void make_archive_atlas(const std::string &archive_par, const std::string &par_savepath, bool par_power_of_two,
+	                        dxt::Quality par_quality = dxt::Quality::Normal) {
 		std::cout << "Making an atlas from the archive: " << archive_par << std::endl;
 		auto a = atlas::make_from_archive(archive_par, par_savepath, par_power_of_two);
-		a.save(par_savepath);
+		a.save(par_savepath, par_quality);
 	}
 }
 %}
@@ -151,6 +181,10 @@ namespace UpsScript {
 	std::shared_ptr<TextureHandler> get_texture_handler();
 	void load_archives();
 	void load_archive(const std::string &pArchive);
+	bool mount_archive(const std::string &pArchive);
+	bool file_exists(const std::string &pPath);
+	std::string read_file(const std::string &pPath);
 	void textures_to_model(Model *pModel);
-	void make_archive_atlas(const std::string &archive_par, const std::string &par_savepath, bool par_power_of_two);
+	void make_archive_atlas(const std::string &archive_par, const std::string &par_savepath, bool par_power_of_two,
+	                        dxt::Quality par_quality = dxt::Quality::Normal);
 }
\ No newline at end of file